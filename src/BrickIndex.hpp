@@ -0,0 +1,96 @@
+#pragma once
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include "util.hpp"
+#include "Vec.hpp"
+#include "VoxelGrid.hpp"
+
+namespace voxel
+{
+    using vec::Vec3;
+
+    /**
+     * Min / max of every brick of cubes in a voxel grid.
+     *
+     * Brick (bx, by, bz) covers the cubes [b * size, b * size + size) on each
+     * axis, so it spans the grid points [b * size, b * size + size] and
+     * neighbouring bricks share their boundary points. A brick can only
+     * contain a surface if its range straddles the isovalue. The index does
+     * not depend on the isovalue, build it once and query it for many.
+     */
+    template <typename T>
+    class BrickIndex
+    {
+    public:
+        BrickIndex(const VoxelGrid<T> &voxels, int brickSize = 8, int threads = 1);
+
+        int brick_size() const { return size; };
+        // number of bricks on each axis
+        const Vec3<int> &dims() const { return shape; };
+
+        T min(int bx, int by, int bz) const { return mins[index(bx, by, bz)]; };
+        T max(int bx, int by, int bz) const { return maxs[index(bx, by, bz)]; };
+
+        // whether the brick may contain cubes with corners on both sides of isovalue,
+        // which may be of a wider type than T
+        template <typename U>
+        bool straddles(int bx, int by, int bz, U isovalue) const
+        {
+            const auto i = index(bx, by, bz);
+            return mins[i] < isovalue && !(maxs[i] < isovalue);
+        };
+
+    private:
+        int size;
+        Vec3<int> shape;
+        std::vector<T> mins;
+        std::vector<T> maxs;
+
+        std::size_t index(int bx, int by, int bz) const { return (static_cast<std::size_t>(bx) * shape[1] + by) * shape[2] + bz; };
+    };
+
+    template <typename T>
+    BrickIndex<T>::BrickIndex(const VoxelGrid<T> &voxels, int brickSize, int threads)
+        : size(brickSize)
+    {
+        const auto &dims = voxels.dims();
+        for (int i = 0; i < 3; i++)
+            shape[i] = dims[i] < 2 ? 0 : (dims[i] - 2) / size + 1;
+
+        const auto n = static_cast<std::size_t>(shape[0]) * shape[1] * shape[2];
+        mins.assign(n, std::numeric_limits<T>::max());
+        maxs.assign(n, std::numeric_limits<T>::lowest());
+
+        // one task per brick slab, slabs only share read-only boundary points
+        util::parallel_for(shape[0], threads, [&](int bx)
+                           {
+                               const auto x1 = std::min(bx * size + size, dims[0] - 1);
+                               for (int x = bx * size; x <= x1; x++)
+                                   for (int y = 0; y < dims[1]; y++)
+                                   {
+                                       const auto *row = voxels.row(x, y);
+                                       // bricks holding row y, two on a brick boundary
+                                       const auto by1 = std::min(y / size, shape[1] - 1);
+                                       const auto by0 = y % size == 0 && y > 0 ? y / size - 1 : by1;
+                                       for (int bz = 0; bz < shape[2]; bz++)
+                                       {
+                                           const auto z1 = std::min(bz * size + size, dims[2] - 1);
+                                           auto lo = row[bz * size];
+                                           auto hi = row[bz * size];
+                                           for (int z = bz * size + 1; z <= z1; z++)
+                                           {
+                                               lo = std::min(lo, row[z]);
+                                               hi = std::max(hi, row[z]);
+                                           }
+
+                                           for (int by = by0; by <= by1; by++)
+                                           {
+                                               const auto i = index(bx, by, bz);
+                                               mins[i] = std::min(mins[i], lo);
+                                               maxs[i] = std::max(maxs[i], hi);
+                                           }
+                                       }
+                                   } });
+    }
+}
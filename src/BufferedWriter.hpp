@@ -0,0 +1,112 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace util
+{
+    /**
+     * Output file filled through a large chunk buffer, which goes to the file
+     * in one write once full, so a mesh costs a handful of writes however
+     * many elements it has. Binary values are stored little-endian, text is
+     * formatted straight into the buffer through reserve_bytes / commit.
+     * Like std::ofstream, the file is completed on destruction if close()
+     * was not called, but only close() reports a failed write.
+     */
+    class BufferedWriter
+    {
+    public:
+        static constexpr std::size_t CHUNK_BYTES = 4 << 20;
+
+        BufferedWriter(const std::string &filePath);
+        ~BufferedWriter();
+
+        void put_bytes(const char *bytes, std::size_t n);
+        template <typename U>
+        void put(U value);
+
+        // at least n free bytes, n at most CHUNK_BYTES; commit(end) keeps [reserve_bytes(n), end)
+        char *reserve_bytes(std::size_t n);
+        void commit(const char *end) { used = end - buffer.data(); };
+
+        // write what is left in the buffer, reports a failed write
+        void close();
+
+    private:
+        std::string path;
+        std::ofstream stream;
+        std::vector<char> buffer;
+        std::size_t used = 0;
+
+        void flush();
+    };
+
+    inline BufferedWriter::BufferedWriter(const std::string &filePath)
+        : path(filePath), stream(filePath, std::ios::out | std::ios::binary), buffer(CHUNK_BYTES)
+    {
+        if (!stream)
+            throw std::runtime_error("failed to open for writing: " + filePath);
+    }
+
+    inline BufferedWriter::~BufferedWriter()
+    {
+        if (stream.is_open())
+            flush();
+    }
+
+    inline void BufferedWriter::put_bytes(const char *bytes, std::size_t n)
+    {
+        if (used + n > buffer.size())
+        {
+            flush();
+            // too large to be worth a copy
+            if (n > buffer.size())
+            {
+                stream.write(bytes, n);
+                return;
+            }
+        }
+
+        std::memcpy(buffer.data() + used, bytes, n);
+        used += n;
+    }
+
+    template <typename U>
+    void BufferedWriter::put(U value)
+    {
+        static_assert(std::is_arithmetic_v<U>);
+        char bytes[sizeof(U)];
+        std::memcpy(bytes, &value, sizeof(U));
+        if constexpr (std::endian::native == std::endian::big)
+            std::reverse(bytes, bytes + sizeof(U));
+
+        put_bytes(bytes, sizeof(U));
+    }
+
+    inline char *BufferedWriter::reserve_bytes(std::size_t n)
+    {
+        if (used + n > buffer.size())
+            flush();
+
+        return buffer.data() + used;
+    }
+
+    inline void BufferedWriter::flush()
+    {
+        stream.write(buffer.data(), used);
+        used = 0;
+    }
+
+    inline void BufferedWriter::close()
+    {
+        flush();
+        stream.close();
+        if (!stream)
+            throw std::runtime_error("failed to write: " + path);
+    }
+}
@@ -0,0 +1,154 @@
+#pragma once
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace util
+{
+    /**
+     * Min-heap of ids in [0, capacity) ordered by a key, with D children per
+     * node. Every id is in the heap at most once and its position is tracked,
+     * so the key of an id can be changed or the id removed in O(log n)
+     * instead of pushing a new entry and skipping the stale one on pop.
+     */
+    template <typename Key, int D = 4>
+    class IndexedHeap
+    {
+    public:
+        IndexedHeap(int capacity = 0) : positions(capacity, NONE){};
+
+        bool empty() const { return entries.empty(); };
+        std::size_t size() const { return entries.size(); };
+        bool contains(int id) const { return positions[id] != NONE; };
+
+        int top() const { return entries.front().id; };
+        const Key &top_key() const { return entries.front().key; };
+        const Key &key(int id) const { return entries[positions[id]].key; };
+
+        // capacity grows to hold id if needed
+        void push(int id, const Key &key);
+        // push id, or change its key if it is already in the heap
+        void update(int id, const Key &key);
+        void remove(int id);
+        int pop();
+
+    private:
+        struct Entry
+        {
+            Key key;
+            int id;
+        };
+
+        static constexpr int NONE = -1;
+        std::vector<Entry> entries;
+        std::vector<int> positions;
+
+        void place(int i, Entry &&entry);
+        void sift_up(int i);
+        void sift_down(int i);
+    };
+
+    template <typename Key, int D>
+    void IndexedHeap<Key, D>::push(int id, const Key &key)
+    {
+        if (static_cast<std::size_t>(id) >= positions.size())
+            positions.resize(id + 1, NONE);
+
+        entries.emplace_back(Entry{key : key, id : id});
+        positions[id] = entries.size() - 1;
+        sift_up(entries.size() - 1);
+    }
+
+    template <typename Key, int D>
+    void IndexedHeap<Key, D>::update(int id, const Key &key)
+    {
+        if (static_cast<std::size_t>(id) >= positions.size() || !contains(id))
+            return push(id, key);
+
+        const int i = positions[id];
+        const bool decreased = key < entries[i].key;
+        entries[i].key = key;
+        if (decreased)
+            sift_up(i);
+        else
+            sift_down(i);
+    }
+
+    template <typename Key, int D>
+    void IndexedHeap<Key, D>::remove(int id)
+    {
+        const int i = positions[id];
+        positions[id] = NONE;
+        auto last = std::move(entries.back());
+        entries.pop_back();
+        if (static_cast<std::size_t>(i) == entries.size())
+            return;
+
+        // the last entry fills the hole, and may belong above or below it
+        const bool decreased = last.key < entries[i].key;
+        place(i, std::move(last));
+        if (decreased)
+            sift_up(i);
+        else
+            sift_down(i);
+    }
+
+    template <typename Key, int D>
+    int IndexedHeap<Key, D>::pop()
+    {
+        const int id = top();
+        remove(id);
+        return id;
+    }
+
+    template <typename Key, int D>
+    void IndexedHeap<Key, D>::place(int i, Entry &&entry)
+    {
+        positions[entry.id] = i;
+        entries[i] = std::move(entry);
+    }
+
+    template <typename Key, int D>
+    void IndexedHeap<Key, D>::sift_up(int i)
+    {
+        auto entry = std::move(entries[i]);
+        while (i > 0)
+        {
+            const int parent = (i - 1) / D;
+            if (!(entry.key < entries[parent].key))
+                break;
+
+            place(i, std::move(entries[parent]));
+            i = parent;
+        }
+
+        place(i, std::move(entry));
+    }
+
+    template <typename Key, int D>
+    void IndexedHeap<Key, D>::sift_down(int i)
+    {
+        const int n = entries.size();
+        auto entry = std::move(entries[i]);
+        while (true)
+        {
+            const int first = D * i + 1;
+            if (first >= n)
+                break;
+
+            // smallest child
+            int child = first;
+            for (int c = first + 1; c < std::min(first + D, n); c++)
+                if (entries[c].key < entries[child].key)
+                    child = c;
+
+            if (!(entries[child].key < entry.key))
+                break;
+
+            place(i, std::move(entries[child]));
+            i = child;
+        }
+
+        place(i, std::move(entry));
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MAPPED_FILE_POSIX
+#endif
+
+namespace util
+{
+    /**
+     * Whole file as read-only bytes. Memory mapped where POSIX mmap exists,
+     * so pages are only brought in as they are read, otherwise read into a
+     * buffer in one go.
+     */
+    class MappedFile
+    {
+    public:
+        MappedFile(const std::string &filePath);
+        ~MappedFile();
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        const char *data() const { return bytes; };
+        std::size_t size() const { return length; };
+
+    private:
+        const char *bytes = nullptr;
+        std::size_t length = 0;
+        // contents when the file is not mapped
+        std::vector<char> buffer;
+    };
+
+#ifdef MAPPED_FILE_POSIX
+    inline MappedFile::MappedFile(const std::string &filePath)
+    {
+        const int fd = open(filePath.c_str(), O_RDONLY);
+        if (fd == -1)
+            throw std::runtime_error("failed to open: " + filePath);
+
+        struct stat info;
+        if (fstat(fd, &info) == -1)
+        {
+            close(fd);
+            throw std::runtime_error("failed to stat: " + filePath);
+        }
+
+        length = info.st_size;
+        // an empty file cannot be mapped, and needs no bytes
+        if (length > 0)
+        {
+            void *p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED)
+            {
+                close(fd);
+                throw std::runtime_error("failed to map: " + filePath);
+            }
+
+            madvise(p, length, MADV_SEQUENTIAL);
+            bytes = static_cast<const char *>(p);
+        }
+
+        close(fd);
+    }
+
+    inline MappedFile::~MappedFile()
+    {
+        if (length > 0)
+            munmap(const_cast<char *>(bytes), length);
+    }
+#else
+    inline MappedFile::MappedFile(const std::string &filePath)
+    {
+        std::ifstream stream(filePath, std::ios::in | std::ios::binary | std::ios::ate);
+        if (!stream)
+            throw std::runtime_error("failed to open: " + filePath);
+
+        buffer.resize(stream.tellg());
+        stream.seekg(0);
+        if (!stream.read(buffer.data(), buffer.size()))
+            throw std::runtime_error("failed to read: " + filePath);
+
+        bytes = buffer.data();
+        length = buffer.size();
+    }
+
+    inline MappedFile::~MappedFile() {}
+#endif
+}
@@ -1,4 +1,6 @@
 #pragma once
+#include <algorithm>
+#include <vector>
 #include "Vec.hpp"
 
 namespace mesh
@@ -21,6 +23,14 @@ namespace mesh
         std::vector<Vec3<int>> faces;
     };
 
+    // whether any vertex carries a normal, vertices without one keep the zero vector
+    template <typename T>
+    bool has_normals(const Mesh<T> &mesh)
+    {
+        return std::any_of(mesh.vertices.begin(), mesh.vertices.end(), [](const Vertex<T> &v)
+                           { return vec::norm2(v.normal) > 0; });
+    }
+
     bool hasDegenerate(const Vec3<int> &face)
     {
         return (face[0] == face[1]) || (face[1] == face[2]) || (face[2] == face[0]);
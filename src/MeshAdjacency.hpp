@@ -0,0 +1,170 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <span>
+#include <vector>
+#include "Mesh.hpp"
+#include "Vec.hpp"
+
+namespace mesh
+{
+    /**
+     * A list of ints per vertex, all in one flat array: the list of vertex v
+     * is ids[begin[v], begin[v] + count[v]), with room up to begin[v] +
+     * capacity[v]. Lists are laid out back to back when built; one that
+     * outgrows its room moves to the end of the array with twice the room,
+     * so edits stay local and amortized O(1) without a container per vertex.
+     * Once reserve has made room, pushing to the lists of different vertices
+     * does not move them, and they can be edited concurrently.
+     */
+    class VertexLists
+    {
+    public:
+        VertexLists() = default;
+        // empty lists with room for counts[v] ids each
+        VertexLists(const std::vector<int> &counts);
+
+        int size() const { return begin.size(); };
+        std::span<const int> operator[](int v) const { return {ids.data() + begin[v], static_cast<std::size_t>(count[v])}; };
+        std::span<int> operator[](int v) { return {ids.data() + begin[v], static_cast<std::size_t>(count[v])}; };
+
+        // room for n ids in the list of v
+        void reserve(int v, int n);
+        void push_back(int v, int id);
+        // remove one id from the list of v, the last id takes its place
+        void erase(int v, int id);
+        // remove the ids of v for which pred(id) holds, keeping the order of the rest
+        template <typename Pred>
+        void erase_if(int v, const Pred &pred);
+        void clear(int v) { count[v] = 0; };
+
+    private:
+        std::vector<int> ids;
+        std::vector<int> begin;
+        std::vector<int> count;
+        std::vector<int> capacity;
+    };
+
+    // faces around every vertex, in one counting pass over the faces
+    inline VertexLists vertex_faces(int vertexN, const std::vector<Vec3<int>> &faces);
+
+    // every edge of the non-degenerate faces once, as {v1, v2} with v1 < v2, ordered by v1
+    inline std::vector<std::array<int, 2>> edges(const std::vector<Vec3<int>> &faces, const VertexLists &vertexFaces);
+
+    // edges around every vertex, as indices into edges
+    inline VertexLists vertex_edges(int vertexN, const std::vector<std::array<int, 2>> &edges);
+
+    inline VertexLists::VertexLists(const std::vector<int> &counts)
+        : begin(counts.size()), count(counts.size(), 0), capacity(counts)
+    {
+        std::size_t n = 0;
+        for (std::size_t v = 0; v < counts.size(); v++)
+        {
+            begin[v] = n;
+            n += counts[v];
+        }
+
+        ids.resize(n);
+    }
+
+    inline void VertexLists::reserve(int v, int n)
+    {
+        if (n <= capacity[v])
+            return;
+
+        const int moved = ids.size();
+        capacity[v] = std::max(n, 2 * capacity[v]);
+        ids.resize(ids.size() + capacity[v]);
+        std::copy(ids.begin() + begin[v], ids.begin() + begin[v] + count[v], ids.begin() + moved);
+        begin[v] = moved;
+    }
+
+    inline void VertexLists::push_back(int v, int id)
+    {
+        if (count[v] == capacity[v])
+            reserve(v, std::max(2 * capacity[v], 4));
+
+        ids[begin[v] + count[v]++] = id;
+    }
+
+    inline void VertexLists::erase(int v, int id)
+    {
+        auto list = (*this)[v];
+        auto it = std::find(list.begin(), list.end(), id);
+        if (it == list.end())
+            return;
+
+        *it = list.back();
+        count[v]--;
+    }
+
+    template <typename Pred>
+    void VertexLists::erase_if(int v, const Pred &pred)
+    {
+        auto list = (*this)[v];
+        count[v] = std::remove_if(list.begin(), list.end(), pred) - list.begin();
+    }
+
+    inline VertexLists vertex_faces(int vertexN, const std::vector<Vec3<int>> &faces)
+    {
+        std::vector<int> counts(vertexN, 0);
+        for (const auto &face : faces)
+            for (int k = 0; k < 3; k++)
+                counts[face[k]]++;
+
+        VertexLists lists(counts);
+        for (int i = 0; i < static_cast<int>(faces.size()); i++)
+            for (int k = 0; k < 3; k++)
+            {
+                // a degenerate face is listed once per vertex
+                const auto &face = faces[i];
+                const bool repeated = (k > 0 && face[k] == face[0]) || (k > 1 && face[k] == face[1]);
+                if (!repeated)
+                    lists.push_back(face[k], i);
+            }
+
+        return lists;
+    }
+
+    inline std::vector<std::array<int, 2>> edges(const std::vector<Vec3<int>> &faces, const VertexLists &vertexFaces)
+    {
+        std::vector<std::array<int, 2>> result;
+        // last vertex an edge to each vertex was found from
+        std::vector<int> seen(vertexFaces.size(), -1);
+        for (int v = 0; v < vertexFaces.size(); v++)
+            for (auto faceID : vertexFaces[v])
+            {
+                const auto &face = faces[faceID];
+                if (hasDegenerate(face))
+                    continue;
+
+                for (int k = 0; k < 3; k++)
+                    if (face[k] > v && seen[face[k]] != v)
+                    {
+                        seen[face[k]] = v;
+                        result.emplace_back(std::array<int, 2>{v, face[k]});
+                    }
+            }
+
+        return result;
+    }
+
+    inline VertexLists vertex_edges(int vertexN, const std::vector<std::array<int, 2>> &edges)
+    {
+        std::vector<int> counts(vertexN, 0);
+        for (const auto &edge : edges)
+        {
+            counts[edge[0]]++;
+            counts[edge[1]]++;
+        }
+
+        VertexLists lists(counts);
+        for (int i = 0; i < static_cast<int>(edges.size()); i++)
+        {
+            lists.push_back(edges[i][0], i);
+            lists.push_back(edges[i][1], i);
+        }
+
+        return lists;
+    }
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace util
+{
+    /**
+     * Task queue served by a set of worker threads. Workers are started on
+     * demand, up to the largest count any caller asked for, and live until
+     * the pool is destroyed. One shared pool serves the whole pipeline, see
+     * ThreadPool::shared(), so stages do not spawn threads of their own.
+     */
+    class ThreadPool
+    {
+    public:
+        ThreadPool() = default;
+        ~ThreadPool();
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        static ThreadPool &shared();
+
+        // start workers until there are at least n
+        void reserve(int n);
+        int size();
+
+        // run task on some worker, tasks start in submission order
+        void submit(std::function<void()> task);
+
+    private:
+        std::mutex mutex;
+        std::condition_variable available;
+        std::deque<std::function<void()>> tasks;
+        std::vector<std::thread> workers;
+        bool stopping = false;
+
+        void work();
+    };
+
+    inline ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+
+        available.notify_all();
+        for (auto &w : workers)
+            w.join();
+    }
+
+    inline ThreadPool &ThreadPool::shared()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    inline void ThreadPool::reserve(int n)
+    {
+        std::lock_guard lock(mutex);
+        while (static_cast<int>(workers.size()) < n)
+            workers.emplace_back([this]()
+                                 { work(); });
+    }
+
+    inline int ThreadPool::size()
+    {
+        std::lock_guard lock(mutex);
+        return workers.size();
+    }
+
+    inline void ThreadPool::submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard lock(mutex);
+            tasks.emplace_back(std::move(task));
+        }
+
+        available.notify_one();
+    }
+
+    inline void ThreadPool::work()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(mutex);
+                available.wait(lock, [this]()
+                               { return stopping || !tasks.empty(); });
+                if (tasks.empty())
+                    return;
+
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+
+            task();
+        }
+    }
+}
@@ -9,7 +9,7 @@ namespace vec
     class Vec3
     {
     public:
-        Vec3(){};
+        Vec3() : data({}){};
         Vec3(T x, T y, T z) : data({x, y, z}){};
 
         T &operator[](int i) { return data[i]; };
@@ -1,193 +1,454 @@
 #pragma once
 #include <array>
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <functional>
 #include <vector>
 #include <string>
 #include <memory>
 #include <limits>
+#include <stdexcept>
+#include <type_traits>
 #include <tiffio.h>
+#include "util.hpp"
 #include "Vec.hpp"
+#include "VoxelGrid.hpp"
+#include "VoxelSmooth.hpp"
 
 namespace voxel
 {
     using vec::Vec3;
 
-    template <typename T>
-    using Voxels = std::vector<std::vector<std::vector<T>>>;
+    /**
+     * Multi-page TIFF opened for reading one page at a time, so a stack can be
+     * consumed without holding all of it. All pages must share one size.
+     *
+     * 8 and 16 bit grayscale pages are decoded strip by strip or tile by tile
+     * straight into the destination, other photometrics go through libtiff's
+     * RGBA conversion and keep the green channel.
+     *
+     * Directory offsets are scanned once on open, so any page is reached
+     * without walking the directory chain. A copy opens its own handle and
+     * shares the scan, copies can read pages concurrently.
+     */
+    class TiffReader
+    {
+    public:
+        TiffReader(const std::string &filePath);
+        ~TiffReader() { TIFFClose(tif); };
+        TiffReader(const TiffReader &other);
+        TiffReader &operator=(const TiffReader &) = delete;
+
+        int pages() const { return offsets.size(); };
+        int height() const { return h; };
+        int width() const { return w; };
+        // depth of the decoded samples, 16 for a 16 bit grayscale stack, otherwise 8
+        int bits_per_sample() const { return bits; };
+
+        // decode page i into dst, height * width samples, rows top to bottom
+        template <typename T>
+        void read_page(int i, T *dst);
+
+    private:
+        std::string path;
+        TIFF *tif;
+        uint32 w = 0;
+        uint32 h = 0;
+        int bits = 8;
+        // offset of every page directory
+        std::vector<toff_t> offsets;
+        // one decoded strip or tile, and the raster of the RGBA fallback
+        std::vector<uint8> buffer;
+        std::vector<uint32> raster;
+
+        bool is_grayscale(bool &invert) const;
+        template <typename T>
+        void read_grayscale(bool invert, T *dst);
+        template <typename T>
+        void read_rgba(T *dst);
+        template <typename T>
+        void copy_samples(const uint8 *src, std::size_t n, bool invert, T *dst) const;
+    };
 
     namespace _private
     {
-        template <typename T>
-        Voxels<T> read_tiff_imgs(std::string filePath);
+        template <typename Tsample, typename T>
+        VoxelGrid<T> read_tiff_imgs(TiffReader &tiff, int threads);
 
         template <typename Tin, typename Tout, int Scale = std::numeric_limits<Tin>::max()>
-        Voxels<Tout> normalize(Voxels<Tin> imgs);
+        void normalize(const Tin *src, std::size_t n, Tout *dst);
 
-        template <typename T>
-        Voxels<T> smooth(const Voxels<T> &voxels, const std::vector<T> &gaussian_vector);
+        template <typename Tin, typename Tout>
+        void rescale(const Tin *src, std::size_t n, Tout *dst);
+
+        template <typename T, int Size = 0>
+        VoxelGrid<T> smooth(const VoxelGrid<T> &voxels, const SmoothReal<T> *taps, int size, Border border, int threads);
 
         template <typename T>
         constexpr std::vector<T> generate_gaussian_vector(int size, double sigma);
     }
 
+    /**
+     * Read a multi-page TIFF into a grid normalized to [0, 1], one page per x
+     * slice. Pages are decoded on up to `threads` threads and normalized
+     * straight into their slices.
+     */
     template <typename T>
-    Voxels<T> read_from_tiff(std::string filePath)
+    VoxelGrid<T> read_from_tiff(std::string filePath, int threads = 1)
     {
-        auto imgs = _private::read_tiff_imgs<uint8>(filePath);
-        return _private::normalize<uint8, T>(imgs);
+        static_assert(std::is_floating_point_v<T>, "normalized voxels need a floating point type");
+        TiffReader tiff(filePath);
+        if (tiff.bits_per_sample() == 16)
+            return _private::read_tiff_imgs<uint16, T>(tiff, threads);
+
+        return _private::read_tiff_imgs<uint8, T>(tiff, threads);
     }
 
-    template <typename T, int Size>
-    Voxels<T> smooth(const Voxels<T> &voxels)
+    /**
+     * Read a multi-page TIFF keeping integer samples, scaled to the full range
+     * of T (uint8_t or uint16_t), so an 8 bit stack takes a quarter of the
+     * memory of a float grid. Use scale_isovalue<T> to extract from it the
+     * surface of the normalized grid.
+     */
+    template <typename T>
+    VoxelGrid<T> read_raw_from_tiff(std::string filePath, int threads = 1)
     {
-        const auto vec = _private::generate_gaussian_vector<T>(Size, 0.8);
-        return _private::smooth<T>(voxels, vec);
+        static_assert(std::is_integral_v<T> && std::is_unsigned_v<T>, "raw voxels need an unsigned integer type");
+        TiffReader tiff(filePath);
+        if (tiff.bits_per_sample() == 16)
+            return _private::read_tiff_imgs<uint16, T>(tiff, threads);
+
+        return _private::read_tiff_imgs<uint8, T>(tiff, threads);
     }
 
+    // isovalue of a [0, 1] grid, scaled to the same surface of a grid from read_raw_from_tiff<T>
     template <typename T>
-    Voxels<T> smooth(const Voxels<T> &voxels, int size)
+    constexpr double scale_isovalue(double isovalue)
+    {
+        return isovalue * std::numeric_limits<T>::max();
+    }
+
+    /**
+     * Separable Gaussian smoothing with a kernel of Size taps centred on each
+     * voxel, the grid is extended past its border as given. Slices are
+     * smoothed on up to `threads` threads. The taps are computed at compile
+     * time and the filter loops are specialized for Size. Integer grids are
+     * filtered in float and rounded back.
+     */
+    template <typename T, int Size, double Sigma = 0.8>
+    VoxelGrid<T> smooth(const VoxelGrid<T> &voxels, Border border = Border::clamp, int threads = 1)
     {
-        const auto vec = _private::generate_gaussian_vector<T>(size, 0.8);
-        return _private::smooth<T>(voxels, vec);
+        static constexpr auto taps = _private::gaussian_kernel<_private::SmoothReal<T>, Size>(Sigma);
+        return _private::smooth<T, Size>(voxels, taps.data(), Size, border, threads);
     }
 
+    // common sizes run the specialized filters, others a generic one
     template <typename T>
-    Vec3<T> get_normal(const Voxels<T> &voxels, int x, int y, int z)
-    {
-        // TODO: following code like noodles
-        const auto val = voxels[x][y][z];
-        Vec3<T> normal;
-        normal[0] = x == 0 ? voxels[x + 1][y][z] - val
-                    : x == voxels.size() - 1
-                        ? val - voxels[x - 1][y][z]
-                        : (voxels[x + 1][y][z] - voxels[x - 1][y][z]) / 2;
-
-        normal[1] = y == 0 ? voxels[x][y + 1][z] - val
-                    : y == voxels[x].size() - 1
-                        ? val - voxels[x][y - 1][z]
-                        : (voxels[x][y + 1][z] - voxels[x][y - 1][z]) / 2;
-
-        normal[2] = z == 0 ? voxels[x][y][z + 1] - val
-                    : z == voxels[x][y].size() - 1
-                        ? val - voxels[x][y][z - 1]
-                        : (voxels[x][y][z + 1] - voxels[x][y][z - 1]) / 2;
+    VoxelGrid<T> smooth(const VoxelGrid<T> &voxels, int size, Border border = Border::clamp, int threads = 1)
+    {
+        switch (size)
+        {
+        case 3:
+            return smooth<T, 3>(voxels, border, threads);
+        case 5:
+            return smooth<T, 5>(voxels, border, threads);
+        case 7:
+            return smooth<T, 7>(voxels, border, threads);
+        case 9:
+            return smooth<T, 9>(voxels, border, threads);
+        default:
+            break;
+        }
+
+        const auto vec = _private::generate_gaussian_vector<_private::SmoothReal<T>>(size, 0.8);
+        return _private::smooth<T>(voxels, vec.data(), size, border, threads);
+    }
+
+    /**
+     * Normalized gradient at (y, z) of slice `cur`, given its neighbour slices
+     * along x (nullptr outside the grid). Central difference inside the grid,
+     * one-sided difference on the border, computed in V.
+     */
+    template <typename T, typename V = T>
+    Vec3<V> get_normal(const T *prev, const T *cur, const T *next, int Y, int Z, int y, int z, const Vec3<float> &spacing)
+    {
+        const auto p = static_cast<std::size_t>(y) * Z + z;
+        auto at = [](const T *slice, std::size_t i)
+        { return static_cast<V>(slice[i]); };
+
+        const auto val = at(cur, p);
+        Vec3<V> normal;
+        normal[0] = prev == nullptr ? at(next, p) - val
+                    : next == nullptr
+                        ? val - at(prev, p)
+                        : (at(next, p) - at(prev, p)) / 2;
+
+        normal[1] = y == 0 ? at(cur, p + Z) - val
+                    : y == Y - 1
+                        ? val - at(cur, p - Z)
+                        : (at(cur, p + Z) - at(cur, p - Z)) / 2;
+
+        normal[2] = z == 0 ? at(cur, p + 1) - val
+                    : z == Z - 1
+                        ? val - at(cur, p - 1)
+                        : (at(cur, p + 1) - at(cur, p - 1)) / 2;
+
+        for (int i = 0; i < 3; i++)
+            normal[i] /= spacing[i];
 
         return vec::normalize(normal);
     }
 
-    namespace _private
+    template <typename T>
+    Vec3<T> get_normal(const VoxelGrid<T> &voxels, int x, int y, int z)
     {
-        template <typename T>
-        Voxels<T> read_tiff_imgs(std::string filePath)
+        const auto &dims = voxels.dims();
+        return get_normal<T>(x == 0 ? nullptr : voxels.slice(x - 1),
+                             voxels.slice(x),
+                             x == dims[0] - 1 ? nullptr : voxels.slice(x + 1),
+                             dims[1], dims[2], y, z, voxels.spacing);
+    }
+
+    inline TiffReader::TiffReader(const std::string &filePath)
+        : path(filePath), tif(TIFFOpen(filePath.c_str(), "r"))
+    {
+        if (tif == nullptr)
+            throw std::runtime_error("failed to open tiff: " + filePath);
+
+        TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &w);
+        TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &h);
+
+        // the first page decides the depth of the whole stack
+        bool invert = false;
+        uint16 bps = 0;
+        TIFFGetFieldDefaulted(tif, TIFFTAG_BITSPERSAMPLE, &bps);
+        bits = bps;
+        if (!is_grayscale(invert))
+            bits = 8;
+
+        do
+            offsets.emplace_back(TIFFCurrentDirOffset(tif));
+        while (TIFFReadDirectory(tif));
+    }
+
+    inline TiffReader::TiffReader(const TiffReader &other)
+        : path(other.path), tif(TIFFOpen(other.path.c_str(), "r")),
+          w(other.w), h(other.h), bits(other.bits), offsets(other.offsets)
+    {
+        if (tif == nullptr)
+            throw std::runtime_error("failed to open tiff: " + path);
+    }
+
+    template <typename T>
+    void TiffReader::read_page(int i, T *dst)
+    {
+        if (!TIFFSetSubDirectory(tif, offsets[i]))
+            throw std::runtime_error("failed to read tiff directory: " + path);
+
+        uint32 pw = 0, ph = 0;
+        TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &pw);
+        TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &ph);
+        if (pw != w || ph != h)
+            throw std::runtime_error("tiff pages differ in size: " + path);
+
+        bool invert = false;
+        if (is_grayscale(invert))
+            read_grayscale(invert, dst);
+        else
+            read_rgba(dst);
+    }
+
+    // single channel unsigned samples of the stack's depth, stored top-left first
+    inline bool TiffReader::is_grayscale(bool &invert) const
+    {
+        uint16 photometric = 0, bps = 0, spp = 0, format = 0, orientation = 0;
+        if (!TIFFGetField(tif, TIFFTAG_PHOTOMETRIC, &photometric))
+            return false;
+
+        TIFFGetFieldDefaulted(tif, TIFFTAG_BITSPERSAMPLE, &bps);
+        TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLESPERPIXEL, &spp);
+        TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLEFORMAT, &format);
+        TIFFGetFieldDefaulted(tif, TIFFTAG_ORIENTATION, &orientation);
+        invert = photometric == PHOTOMETRIC_MINISWHITE;
+        return (photometric == PHOTOMETRIC_MINISBLACK || photometric == PHOTOMETRIC_MINISWHITE) &&
+               (bps == 8 || bps == 16) && bps == bits && spp == 1 &&
+               format == SAMPLEFORMAT_UINT && orientation == ORIENTATION_TOPLEFT;
+    }
+
+    template <typename T>
+    void TiffReader::read_grayscale(bool invert, T *dst)
+    {
+        const auto bytes = bits / 8;
+        if (!TIFFIsTiled(tif))
         {
-            using Row = std::vector<T>;
-            using Img = std::vector<Row>;
+            uint32 rowsPerStrip = 0;
+            TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &rowsPerStrip);
+            rowsPerStrip = std::min(rowsPerStrip, h);
+            // samples already in the destination format are decoded in place
+            const bool direct = std::is_integral_v<T> && sizeof(T) == bytes && !invert;
+            if (!direct)
+                buffer.resize(std::max<std::size_t>(buffer.size(), TIFFStripSize(tif)));
+
+            for (uint32 y = 0, s = 0; y < h; y += rowsPerStrip, s++)
+            {
+                const auto n = static_cast<std::size_t>(std::min(rowsPerStrip, h - y)) * w;
+                auto *pDst = dst + static_cast<std::size_t>(y) * w;
+                auto *pBuf = direct ? reinterpret_cast<uint8 *>(pDst) : buffer.data();
+                if (TIFFReadEncodedStrip(tif, s, pBuf, n * bytes) < 0)
+                    throw std::runtime_error("failed to decode tiff strip: " + path);
+
+                if (!direct)
+                    copy_samples(buffer.data(), n, invert, pDst);
+            }
 
-            auto tif = TIFFOpen(filePath.c_str(), "r");
-            auto page = TIFFNumberOfDirectories(tif);
+            return;
+        }
 
-            std::vector<Img> imgs;
-            for (auto i = 0; i < page; i++)
+        uint32 tw = 0, th = 0;
+        TIFFGetField(tif, TIFFTAG_TILEWIDTH, &tw);
+        TIFFGetField(tif, TIFFTAG_TILELENGTH, &th);
+        buffer.resize(std::max<std::size_t>(buffer.size(), TIFFTileSize(tif)));
+        for (uint32 ty = 0; ty < h; ty += th)
+            for (uint32 tx = 0; tx < w; tx += tw)
             {
-                TIFFSetDirectory(tif, i);
-
-                int w;
-                auto ret = TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &w); // TODO: handle ret
-
-                int h;
-                ret = TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &h); // TODO: handle ret
-
-                auto tmp = new uint32[w * h];
-                TIFFReadRGBAImage(tif, w, h, tmp, 0);
-                uint32 *pRow = tmp + (h - 1) * w;
-                Img img;
-                for (int i = 0; i < h; i++)
-                {
-                    Row row;
-                    uint32 *pCol = pRow;
-                    for (int j = 0; j < w; j++)
-                    {
-                        row.push_back(TIFFGetG(*pCol));
-                        pCol++;
-                    }
-                    pRow -= w;
-                    img.push_back(std::move(row));
-                }
-
-                imgs.push_back(std::move(img));
-                delete[] tmp;
+                if (TIFFReadTile(tif, buffer.data(), tx, ty, 0, 0) < 0)
+                    throw std::runtime_error("failed to decode tiff tile: " + path);
+
+                // tiles are padded on the right and bottom edges
+                const auto cols = std::min(tw, w - tx);
+                for (uint32 y = 0; y < std::min(th, h - ty); y++)
+                    copy_samples(buffer.data() + static_cast<std::size_t>(y) * tw * bytes, cols, invert,
+                                 dst + static_cast<std::size_t>(ty + y) * w + tx);
             }
+    }
+
+    template <typename T>
+    void TiffReader::read_rgba(T *dst)
+    {
+        // 8 bit green channel, widened when the stack is 16 bit
+        const T scale = bits == 16 ? 257 : 1;
+        raster.resize(static_cast<std::size_t>(w) * h);
+        if (!TIFFReadRGBAImage(tif, w, h, raster.data(), 0))
+            throw std::runtime_error("failed to decode tiff: " + path);
 
-            TIFFClose(tif);
-            return std::move(imgs);
+        // RGBA raster origin is bottom-left, flip rows while copying
+        for (uint32 j = 0; j < h; j++)
+        {
+            const uint32 *pCol = raster.data() + static_cast<std::size_t>(h - 1 - j) * w;
+            T *pDst = dst + static_cast<std::size_t>(j) * w;
+            for (uint32 k = 0; k < w; k++)
+                pDst[k] = static_cast<T>(TIFFGetG(pCol[k])) * scale;
         }
+    }
 
-        template <typename Tin, typename Tout, int Scale = std::numeric_limits<Tin>::max()>
-        Voxels<Tout> normalize(Voxels<Tin> imgs)
+    template <typename T>
+    void TiffReader::copy_samples(const uint8 *src, std::size_t n, bool invert, T *dst) const
+    {
+        if (bits == 16)
         {
-            Voxels<Tout> newImgs;
-            newImgs.reserve(imgs.size());
-            for (auto &img : imgs)
+            // libtiff hands out samples in host byte order
+            for (std::size_t k = 0; k < n; k++)
             {
-                std::vector<std::vector<Tout>> newImg;
-                newImg.reserve(img.size());
-                for (auto &row : img)
-                {
-                    std::vector<Tout> newRow;
-                    newRow.reserve(row.size());
-                    for (auto &pixel : row)
-                    {
-                        auto val = static_cast<Tout>(pixel) / Scale;
-                        newRow.emplace_back(val);
-                    }
-                    newImg.emplace_back(std::move(newRow));
-                }
-                newImgs.emplace_back(std::move(newImg));
+                uint16 v;
+                std::memcpy(&v, src + 2 * k, 2);
+                dst[k] = static_cast<T>(invert ? 0xffff - v : v);
             }
-            return std::move(newImgs);
+
+            return;
         }
 
-        template <typename T>
-        Voxels<T> smooth(const Voxels<T> &voxels, const std::vector<T> &gaussian_vector)
+        for (std::size_t k = 0; k < n; k++)
+            dst[k] = static_cast<T>(invert ? 0xff - src[k] : src[k]);
+    }
+
+    namespace _private
+    {
+        template <typename Tsample, typename T>
+        VoxelGrid<T> read_tiff_imgs(TiffReader &tiff, int threads)
+        {
+            // Each worker decodes a contiguous block of pages with its own
+            // handle. Samples of the grid's type are decoded straight into
+            // their slices, others into one page buffer and rescaled into the
+            // slice while the page is still in cache.
+            const int page = tiff.pages();
+            VoxelGrid<T> imgs(page, tiff.height(), tiff.width());
+            const auto sliceSize = static_cast<std::size_t>(tiff.height()) * tiff.width();
+            const int blockN = std::max(1, std::min(threads, page));
+            util::parallel_for(blockN, blockN, [&](int b)
+                               {
+                                   std::unique_ptr<TiffReader> copy;
+                                   if (b > 0)
+                                       copy = std::make_unique<TiffReader>(tiff);
+
+                                   auto &reader = b > 0 ? *copy : tiff;
+                                   std::vector<Tsample> buffer;
+                                   for (int i = page * b / blockN; i < page * (b + 1) / blockN; i++)
+                                   {
+                                       if constexpr (std::is_same_v<Tsample, T>)
+                                           reader.read_page(i, imgs.slice(i));
+                                       else
+                                       {
+                                           buffer.resize(sliceSize);
+                                           reader.read_page(i, buffer.data());
+                                           rescale(buffer.data(), sliceSize, imgs.slice(i));
+                                       }
+                                   } });
+
+            return imgs;
+        }
+
+        template <typename Tin, typename Tout, int Scale>
+        void normalize(const Tin *src, std::size_t n, Tout *dst)
+        {
+            for (std::size_t i = 0; i < n; i++)
+                dst[i] = static_cast<Tout>(src[i]) / Scale;
+        }
+
+        // full range of Tin to [0, 1] for floating point Tout, or to the full range of an integer Tout
+        template <typename Tin, typename Tout>
+        void rescale(const Tin *src, std::size_t n, Tout *dst)
         {
-            // Sperate gaussian filter
-            Voxels<T> src;
-            Voxels<T> dst = voxels;
-            int size = gaussian_vector.size();
-            for (int channel = 0; channel < 3; channel++)
+            constexpr auto inMax = std::numeric_limits<Tin>::max();
+            constexpr auto outMax = std::numeric_limits<Tout>::max();
+            if constexpr (std::is_floating_point_v<Tout>)
+                normalize<Tin, Tout>(src, n, dst);
+            else if constexpr (outMax >= inMax)
+            {
+                // 0xff widens to 0xffff by 257, exactly
+                for (std::size_t i = 0; i < n; i++)
+                    dst[i] = static_cast<Tout>(src[i] * (outMax / inMax));
+            }
+            else
             {
-                src = dst;
-                for (int i = 0; i < voxels.size() - size; i++)
-                {
-                    for (int j = 0; j < voxels[0].size() - size; j++)
-                    {
-                        for (int k = 0; k < voxels[0][0].size() - size; k++)
-                        {
-                            T sum = 0;
-                            for (int t = 0; t < size; t++)
-                            {
-                                T val;
-                                if (channel == 0)
-                                    val = src[i + t][j][k];
-                                else if (channel == 1)
-                                    val = src[i][j + t][k];
-                                else if (channel == 2)
-                                    val = src[i][j][k + t];
-
-                                sum += gaussian_vector[t] * val; // x
-                            }
-
-                            if (sum < 0)
-                                sum = static_cast<T>(0);
-                            else if (sum > 1)
-                                sum = static_cast<T>(1);
-
-                            dst[i][j][k] = sum;
-                        }
-                    }
-                }
+                constexpr auto factor = inMax / outMax;
+                for (std::size_t i = 0; i < n; i++)
+                    dst[i] = static_cast<Tout>((src[i] + factor / 2) / factor);
             }
+        }
+
+        template <typename T, int Size>
+        VoxelGrid<T> smooth(const VoxelGrid<T> &voxels, const SmoothReal<T> *taps, int size, Border border, int threads)
+        {
+            // Sperate gaussian filter, fused slice by slice: no full size
+            // intermediate grid, each slice is read from the source once per
+            // tap. Slices are independent, a few blocks per thread share them.
+            const auto &dims = voxels.dims();
+            VoxelGrid<T> dst(dims[0], dims[1], dims[2]);
+            dst.copy_geometry(voxels);
+
+            const int blockN = std::min(dims[0], threads * 4);
+            util::parallel_for(blockN, threads, [&](int b)
+                               {
+                                   std::vector<const T *> window(size);
+                                   std::vector<SmoothReal<T>> scratch;
+                                   for (int i = dims[0] * b / blockN; i < dims[0] * (b + 1) / blockN; i++)
+                                   {
+                                       for (int t = 0; t < size; t++)
+                                           window[t] = voxels.slice(border_index(i + t - size / 2, dims[0], border));
+
+                                       smooth_slice<Size>(window.data(), dims[1], dims[2], taps, size, border, dst.slice(i), scratch);
+                                   } });
 
             return dst;
         }
@@ -195,21 +456,9 @@ namespace voxel
         template <typename T>
         constexpr std::vector<T> generate_gaussian_vector(int size, double sigma)
         {
+            // same taps as gaussian_kernel
             std::vector<T> vec(size);
-            double sum = 0;
-            int origin = size / 2;
-            for (int i = 0; i < size; i++)
-            {
-                // ignore coefficient
-                T g = std::exp(-(i - origin) * (i - origin) / (2 * sigma * sigma));
-                sum += g;
-                vec[i] = g;
-            }
-
-            // normalize
-            for (int i = 0; i < size; i++)
-                vec[i] /= sum;
-
+            gaussian_taps(vec.data(), size, sigma);
             return vec;
         }
     }
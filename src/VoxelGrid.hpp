@@ -0,0 +1,107 @@
+#pragma once
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include "Vec.hpp"
+
+namespace voxel
+{
+    using vec::Vec3;
+
+    constexpr std::size_t GRID_ALIGNMENT = 64; // one cache line, also enough for AVX-512 loads
+
+    template <typename T, std::size_t Alignment = GRID_ALIGNMENT>
+    class AlignedAllocator
+    {
+    public:
+        using value_type = T;
+
+        template <typename U>
+        struct rebind
+        {
+            using other = AlignedAllocator<U, Alignment>;
+        };
+
+        AlignedAllocator() noexcept {};
+        template <typename U>
+        AlignedAllocator(const AlignedAllocator<U, Alignment> &) noexcept {};
+
+        T *allocate(std::size_t n)
+        {
+            // aligned_alloc requires size to be a multiple of alignment
+            auto bytes = (n * sizeof(T) + Alignment - 1) / Alignment * Alignment;
+            auto ptr = std::aligned_alloc(Alignment, bytes == 0 ? Alignment : bytes);
+            if (ptr == nullptr)
+                throw std::bad_alloc();
+
+            return static_cast<T *>(ptr);
+        };
+
+        void deallocate(T *ptr, std::size_t) noexcept { std::free(ptr); };
+
+        template <typename U>
+        bool operator==(const AlignedAllocator<U, Alignment> &) const noexcept { return true; };
+    };
+
+    /**
+     * Dense 3D grid stored in one contiguous, cache-line aligned buffer.
+     *
+     * Layout is x-major, z-contiguous: (x, y, z) lives at x * strides[0] + y * strides[1] + z,
+     * which matches the old `voxels[x][y][z]` nesting (x = page, y = row, z = column).
+     */
+    template <typename T>
+    class VoxelGrid
+    {
+    public:
+        Vec3<float> origin{0, 0, 0};
+        Vec3<float> spacing{1, 1, 1};
+
+        VoxelGrid() : VoxelGrid(0, 0, 0){};
+        VoxelGrid(int X, int Y, int Z, T val = T{})
+            : shape(X, Y, Z),
+              stride(static_cast<std::size_t>(Y) * Z, static_cast<std::size_t>(Z), 1),
+              buffer(static_cast<std::size_t>(X) * Y * Z, val){};
+
+        T &operator()(int x, int y, int z) { return buffer[index(x, y, z)]; };
+        const T &operator()(int x, int y, int z) const { return buffer[index(x, y, z)]; };
+        T &operator[](std::size_t i) { return buffer[i]; };
+        const T &operator[](std::size_t i) const { return buffer[i]; };
+
+        std::size_t index(int x, int y, int z) const { return x * stride[0] + y * stride[1] + z; };
+        const Vec3<int> &dims() const { return shape; };
+        int size(int axis) const { return shape[axis]; };
+        std::size_t size() const { return buffer.size(); };
+        const Vec3<std::size_t> &strides() const { return stride; };
+        bool empty() const { return buffer.empty(); };
+
+        T *data() { return buffer.data(); };
+        const T *data() const { return buffer.data(); };
+        T *slice(int x) { return buffer.data() + x * stride[0]; };
+        const T *slice(int x) const { return buffer.data() + x * stride[0]; };
+        T *row(int x, int y) { return buffer.data() + index(x, y, 0); };
+        const T *row(int x, int y) const { return buffer.data() + index(x, y, 0); };
+
+        // map grid (index space) coordinates to world coordinates
+        template <typename U>
+        Vec3<U> to_world(const Vec3<U> &p) const
+        {
+            return Vec3<U>{static_cast<U>(origin[0] + spacing[0] * p[0]),
+                           static_cast<U>(origin[1] + spacing[1] * p[1]),
+                           static_cast<U>(origin[2] + spacing[2] * p[2])};
+        };
+
+        // copy origin and spacing, used when a pass produces a new grid from an old one
+        template <typename U>
+        void copy_geometry(const VoxelGrid<U> &grid)
+        {
+            origin = grid.origin;
+            spacing = grid.spacing;
+        };
+
+    private:
+        Vec3<int> shape;
+        Vec3<std::size_t> stride;
+        std::vector<T, AlignedAllocator<T>> buffer;
+    };
+}
@@ -0,0 +1,303 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+#include <vector>
+#include "util.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VOXEL_SMOOTH_X86
+#endif
+
+namespace voxel
+{
+    // how smoothing extends the grid past its border
+    enum class Border
+    {
+        clamp,  // repeat the edge voxel: ... a a | a b c
+        mirror, // reflect about the edge voxel: ... c b | a b c
+    };
+
+    namespace _private
+    {
+        constexpr std::size_t SMOOTH_TILE_BYTES = 256 * 1024; // both tile buffers of smooth_slice, about half of L2
+
+        // type the filter of a T grid computes in, integer grids are filtered in float
+        template <typename T>
+        using SmoothReal = std::conditional_t<std::is_floating_point_v<T>, T, float>;
+
+        // filtered value stored back to a T grid, integers are rounded and clamped to their range
+        template <typename T, typename R>
+        inline T from_real(R v)
+        {
+            if constexpr (std::is_floating_point_v<T>)
+                return v;
+            else
+                return static_cast<T>(std::clamp<R>(v + R(0.5), 0, std::numeric_limits<T>::max()));
+        }
+
+        // exp(x) usable in constant expressions: halve x into the range where
+        // the Taylor series converges fast, then square the result back
+        constexpr double constexpr_exp(double x)
+        {
+            if (x > 0)
+                return 1 / constexpr_exp(-x);
+
+            int halvings = 0;
+            for (; x < -0.5; x /= 2)
+                halvings++;
+
+            double term = 1;
+            double sum = 1;
+            for (int i = 1; i < 24; i++)
+            {
+                term *= x / i;
+                sum += term;
+            }
+
+            for (; halvings > 0; halvings--)
+                sum *= sum;
+
+            return sum;
+        }
+
+        // normalized Gaussian of size taps centred on size / 2
+        template <typename T>
+        constexpr void gaussian_taps(T *taps, int size, double sigma)
+        {
+            double sum = 0;
+            const int origin = size / 2;
+            for (int i = 0; i < size; i++)
+            {
+                // ignore coefficient
+                const auto g = static_cast<T>(constexpr_exp(-(i - origin) * (i - origin) / (2 * sigma * sigma)));
+                sum += g;
+                taps[i] = g;
+            }
+
+            // normalize
+            for (int i = 0; i < size; i++)
+                taps[i] /= sum;
+        }
+
+        template <typename T, int Size>
+        constexpr std::array<T, Size> gaussian_kernel(double sigma)
+        {
+            std::array<T, Size> taps{};
+            gaussian_taps(taps.data(), Size, sigma);
+            return taps;
+        }
+
+        // index i of an axis of n voxels, mapped inside [0, n) as the border extends it
+        inline int border_index(int i, int n, Border border)
+        {
+            if (border == Border::clamp || n == 1)
+                return std::clamp(i, 0, n - 1);
+
+            // reflection has period 2 * (n - 1)
+            const int period = 2 * (n - 1);
+            i = ((i % period) + period) % period;
+            return i < n ? i : period - i;
+        }
+
+        /*
+         * Weighted sum of rows, out[k] = g[0] * in[0][k] + g[1] * in[1][k] + ...
+         * Every kernel adds the taps in the same order, so the result does not
+         * depend on the instruction set. Size > 0 fixes the tap count at compile
+         * time so the tap loops unroll, 0 takes it from size.
+         */
+
+        template <int Size, typename Tin, typename R, typename Tout>
+        inline void weighted_sum_scalar(const Tin *const *in, const R *g, int size, int begin, int end, Tout *out)
+        {
+            const int taps = Size > 0 ? Size : size;
+            for (int k = begin; k < end; k++)
+            {
+                R sum = g[0] * in[0][k];
+                for (int t = 1; t < taps; t++)
+                    sum += g[t] * in[t][k];
+
+                out[k] = from_real<Tout>(sum);
+            }
+        }
+
+#ifdef VOXEL_SMOOTH_X86
+        template <int Size>
+        __attribute__((target("sse2"))) inline void weighted_sum_sse2(const float *const *in, const float *g, int size, int n, float *out)
+        {
+            const int taps = Size > 0 ? Size : size;
+            int k = 0;
+            for (; k + 4 <= n; k += 4)
+            {
+                auto sum = _mm_mul_ps(_mm_set1_ps(g[0]), _mm_loadu_ps(in[0] + k));
+                for (int t = 1; t < taps; t++)
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(g[t]), _mm_loadu_ps(in[t] + k)));
+
+                _mm_storeu_ps(out + k, sum);
+            }
+
+            weighted_sum_scalar<Size>(in, g, size, k, n, out);
+        }
+
+        template <int Size>
+        __attribute__((target("sse2"))) inline void weighted_sum_sse2(const double *const *in, const double *g, int size, int n, double *out)
+        {
+            const int taps = Size > 0 ? Size : size;
+            int k = 0;
+            for (; k + 2 <= n; k += 2)
+            {
+                auto sum = _mm_mul_pd(_mm_set1_pd(g[0]), _mm_loadu_pd(in[0] + k));
+                for (int t = 1; t < taps; t++)
+                    sum = _mm_add_pd(sum, _mm_mul_pd(_mm_set1_pd(g[t]), _mm_loadu_pd(in[t] + k)));
+
+                _mm_storeu_pd(out + k, sum);
+            }
+
+            weighted_sum_scalar<Size>(in, g, size, k, n, out);
+        }
+
+        template <int Size>
+        __attribute__((target("avx2"))) inline void weighted_sum_avx2(const float *const *in, const float *g, int size, int n, float *out)
+        {
+            const int taps = Size > 0 ? Size : size;
+            int k = 0;
+            for (; k + 8 <= n; k += 8)
+            {
+                auto sum = _mm256_mul_ps(_mm256_set1_ps(g[0]), _mm256_loadu_ps(in[0] + k));
+                for (int t = 1; t < taps; t++)
+                    sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(g[t]), _mm256_loadu_ps(in[t] + k)));
+
+                _mm256_storeu_ps(out + k, sum);
+            }
+
+            weighted_sum_scalar<Size>(in, g, size, k, n, out);
+        }
+
+        template <int Size>
+        __attribute__((target("avx2"))) inline void weighted_sum_avx2(const double *const *in, const double *g, int size, int n, double *out)
+        {
+            const int taps = Size > 0 ? Size : size;
+            int k = 0;
+            for (; k + 4 <= n; k += 4)
+            {
+                auto sum = _mm256_mul_pd(_mm256_set1_pd(g[0]), _mm256_loadu_pd(in[0] + k));
+                for (int t = 1; t < taps; t++)
+                    sum = _mm256_add_pd(sum, _mm256_mul_pd(_mm256_set1_pd(g[t]), _mm256_loadu_pd(in[t] + k)));
+
+                _mm256_storeu_pd(out + k, sum);
+            }
+
+            weighted_sum_scalar<Size>(in, g, size, k, n, out);
+        }
+#endif
+
+        // out[k] for k in [0, n), out must not overlap the input rows
+        template <int Size, typename Tin, typename R, typename Tout>
+        void weighted_sum(const Tin *const *in, const R *g, int size, int n, Tout *out)
+        {
+#ifdef VOXEL_SMOOTH_X86
+            if constexpr (std::is_same_v<Tin, R> && std::is_same_v<Tout, R> &&
+                          (std::is_same_v<R, float> || std::is_same_v<R, double>))
+            {
+                switch (util::simd_level())
+                {
+                case util::SimdLevel::avx2:
+                    return weighted_sum_avx2<Size>(in, g, size, n, out);
+                case util::SimdLevel::sse2:
+                    return weighted_sum_sse2<Size>(in, g, size, n, out);
+                default:
+                    break;
+                }
+            }
+#endif
+            weighted_sum_scalar<Size>(in, g, size, 0, n, out);
+        }
+
+        /**
+         * Smooth one slice x of a grid into dst, from its x-neighbours
+         * window[t] = slice x + t - size / 2 (already mapped through the border).
+         * Rows are processed in tiles that stay in cache: the x pass writes the
+         * tile and its y halo to one buffer, the y pass writes the other, and
+         * the z pass goes back out to dst. Size is the compile time tap count,
+         * or 0 for a runtime one. The tiles hold R = SmoothReal<T> values, rows
+         * of an integer grid are converted on the way in and out so every pass
+         * runs the R kernels.
+         */
+        template <int Size = 0, typename T, typename R>
+        void smooth_slice(const T *const *window, int Y, int Z, const R *g, int size, Border border,
+                          T *dst, std::vector<R> &scratch)
+        {
+            if constexpr (Size > 0)
+                size = Size;
+
+            const int r = size / 2;
+            const int tileRows = std::max(1, static_cast<int>(SMOOTH_TILE_BYTES / 2 / sizeof(R) / Z) - size);
+            constexpr bool convert = !std::is_same_v<T, R>;
+            const int convertRows = convert ? size + 1 : 0;
+            scratch.resize(static_cast<std::size_t>(2 * tileRows + size + 1 + convertRows) * Z + size);
+            R *haloTile = scratch.data();
+            R *tile = haloTile + static_cast<std::size_t>(tileRows + size) * Z;
+            R *pad = tile + static_cast<std::size_t>(tileRows) * Z;
+            // converted x pass rows, then the z pass output row
+            R *converted = pad + Z + size;
+
+            std::vector<const R *> in(size);
+            for (int j0 = 0; j0 < Y; j0 += tileRows)
+            {
+                const int j1 = std::min(j0 + tileRows, Y);
+                // x pass, rows j0 - r .. j1 - r + size - 1
+                for (int j = j0 - r; j < j1 - r + size - 1; j++)
+                {
+                    const auto row = static_cast<std::size_t>(border_index(j, Y, border)) * Z;
+                    for (int t = 0; t < size; t++)
+                    {
+                        if constexpr (convert)
+                        {
+                            R *c = converted + static_cast<std::size_t>(t) * Z;
+                            std::copy(window[t] + row, window[t] + row + Z, c);
+                            in[t] = c;
+                        }
+                        else
+                            in[t] = window[t] + row;
+                    }
+
+                    weighted_sum<Size>(in.data(), g, size, Z, haloTile + static_cast<std::size_t>(j - j0 + r) * Z);
+                }
+
+                // y pass
+                for (int j = j0; j < j1; j++)
+                {
+                    for (int t = 0; t < size; t++)
+                        in[t] = haloTile + static_cast<std::size_t>(j - j0 + t) * Z;
+
+                    weighted_sum<Size>(in.data(), g, size, Z, tile + static_cast<std::size_t>(j - j0) * Z);
+                }
+
+                // z pass, through a copy of the row with its border
+                for (int j = j0; j < j1; j++)
+                {
+                    const auto *row = tile + static_cast<std::size_t>(j - j0) * Z;
+                    for (int k = -r; k < Z - r + size - 1; k++)
+                        pad[k + r] = row[border_index(k, Z, border)];
+
+                    for (int t = 0; t < size; t++)
+                        in[t] = pad + t;
+
+                    auto *out = dst + static_cast<std::size_t>(j) * Z;
+                    if constexpr (convert)
+                    {
+                        R *c = converted + static_cast<std::size_t>(size) * Z;
+                        weighted_sum<Size>(in.data(), g, size, Z, c);
+                        for (int k = 0; k < Z; k++)
+                            out[k] = from_real<T>(c[k]);
+                    }
+                    else
+                        weighted_sum<Size>(in.data(), g, size, Z, out);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include <bit>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include "BufferedWriter.hpp"
+#include "Mesh.hpp"
+#include "Vec.hpp"
+
+namespace binary_mesh
+{
+    using util::BufferedWriter;
+
+    namespace _private
+    {
+        template <typename T>
+        constexpr const char *ply_type_name()
+        {
+            static_assert(std::is_same_v<T, float> || std::is_same_v<T, double>, "ply output needs float or double vertices");
+            return std::is_same_v<T, float> ? "float" : "double";
+        }
+
+        template <typename T>
+        void put_vertex(BufferedWriter &writer, const mesh::Vertex<T> &v, bool normals)
+        {
+            for (int k = 0; k < 3; k++)
+                writer.put(v.coord[k]);
+
+            if (normals)
+                for (int k = 0; k < 3; k++)
+                    writer.put(v.normal[k]);
+        }
+    }
+
+    /**
+     * Save as binary little-endian PLY: x, y, z and, if normals is set and
+     * the mesh has normals, nx, ny, nz of type T per vertex, then a uchar
+     * count and three int indices per face. A mesh read from OBJ or
+     * simplified carries no normals, and gets no zero normal properties.
+     */
+    template <typename T>
+    void save_ply(const std::string &filePath, const mesh::Mesh<T> &mesh, bool normals = true)
+    {
+        normals = normals && mesh::has_normals(mesh);
+        const std::string type = _private::ply_type_name<T>();
+        std::string header = "ply\n"
+                             "format binary_little_endian 1.0\n"
+                             "element vertex " +
+                             std::to_string(mesh.vertices.size()) + "\n";
+        for (const auto *name : {"x", "y", "z"})
+            header += "property " + type + " " + name + "\n";
+
+        if (normals)
+            for (const auto *name : {"nx", "ny", "nz"})
+                header += "property " + type + " " + name + "\n";
+
+        header += "element face " + std::to_string(mesh.faces.size()) + "\n"
+                  "property list uchar int vertex_indices\n"
+                  "end_header\n";
+
+        BufferedWriter writer(filePath);
+        writer.put_bytes(header.data(), header.size());
+        for (const auto &v : mesh.vertices)
+            _private::put_vertex(writer, v, normals);
+
+        for (const auto &f : mesh.faces)
+        {
+            writer.put(static_cast<uint8_t>(3));
+            for (int k = 0; k < 3; k++)
+                writer.put(static_cast<int32_t>(f[k]));
+        }
+
+        writer.close();
+    }
+
+    /**
+     * Save raw buffers ready for upload to a GPU, without headers: the vertex
+     * buffer holds x, y, z (and nx, ny, nz if normals is set) of type T per
+     * vertex, interleaved, the index buffer three uint32 indices per face.
+     * Both are little-endian.
+     */
+    template <typename T>
+    void save_buffers(const std::string &vertexFilePath, const std::string &indexFilePath, const mesh::Mesh<T> &mesh,
+                      bool normals = true)
+    {
+        BufferedWriter vertexWriter(vertexFilePath);
+        for (const auto &v : mesh.vertices)
+            _private::put_vertex(vertexWriter, v, normals);
+
+        vertexWriter.close();
+
+        BufferedWriter indexWriter(indexFilePath);
+        if constexpr (std::endian::native == std::endian::little && sizeof(vec::Vec3<int>) == 3 * sizeof(uint32_t))
+        {
+            // faces already have the layout of the buffer
+            indexWriter.put_bytes(reinterpret_cast<const char *>(mesh.faces.data()), mesh.faces.size() * sizeof(vec::Vec3<int>));
+        }
+        else
+        {
+            for (const auto &f : mesh.faces)
+                for (int k = 0; k < 3; k++)
+                    indexWriter.put(static_cast<uint32_t>(f[k]));
+        }
+
+        indexWriter.close();
+    }
+}
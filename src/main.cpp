@@ -1,9 +1,15 @@
 #include <chrono>
+#include <cmath>
+#include <iomanip>
 #include <iostream>
 #include <filesystem>
+#include <fstream>
 #include <functional>
+#include <random>
 #include <vector>
+#include "binaryMesh.hpp"
 #include "marchingCubes.hpp"
+#include "marchingCubesStream.hpp"
 #include "obj.hpp"
 #include "quadricErrorMetrics.hpp"
 #include "util.hpp"
@@ -11,14 +17,24 @@
 #include "Mesh.hpp"
 
 void extract_soma_mesh();
+void extract_soma_mesh_streaming();
+void extract_soma_mesh_quantized();
+void check_streaming_borders();
 void simplify_test_mesh();
 void simplify_human_mesh();
+void benchmark_obj_save();
+void benchmark_simplify();
 
 int main()
 {
     extract_soma_mesh();
+    // extract_soma_mesh_streaming();
+    // extract_soma_mesh_quantized();
+    // check_streaming_borders();
     // simplify_test_mesh();
     // simplify_human_mesh();
+    // benchmark_obj_save();
+    // benchmark_simplify();
     return 0;
 }
 
@@ -26,20 +42,21 @@ void extract_soma_mesh()
 {
     constexpr auto img = "../data/seg_ImgSoma_17302_00020-x_14992.3_y_21970.3_z_4344.8.tiff";
     constexpr auto obj = "../tmp/seg_ImgSoma_17302_00020-x_14992.3_y_21970.3_z_4344.8.obj";
+    constexpr auto ply = "../tmp/seg_ImgSoma_17302_00020-x_14992.3_y_21970.3_z_4344.8.ply";
 
     auto imgFilePath = std::filesystem::current_path().append(img);
     auto voxelsRaw = util::run_with_duration(
         "Read voxels", [&imgFilePath]()
-        { return voxel::read_from_tiff<float>(imgFilePath); });
+        { return voxel::read_from_tiff<float>(imgFilePath, util::hardware_threads()); });
 
     auto voxels = util::run_with_duration(
         "Smooth voxels", [](const auto &voxels)
-        { return voxel::smooth<float, 5>(voxels); },
+        { return voxel::smooth<float, 5>(voxels, voxel::Border::clamp, util::hardware_threads()); },
         voxelsRaw);
 
     auto mesh = util::run_with_duration(
         "Extract mesh", [](const auto &voxels)
-        { return marching_cubes::extract<float>(voxels, 0.5); },
+        { return marching_cubes::extract<float>(voxels, 0.5, util::hardware_threads()); },
         voxels);
 
     util::run_with_duration(
@@ -48,6 +65,125 @@ void extract_soma_mesh()
 
     auto objFilePath = std::filesystem::current_path().append(obj);
     obj::save<float>(objFilePath, mesh);
+
+    auto plyFilePath = std::filesystem::current_path().append(ply);
+    binary_mesh::save_ply<float>(plyFilePath, mesh);
+}
+
+void extract_soma_mesh_streaming()
+{
+    constexpr auto img = "../data/seg_ImgSoma_17302_00020-x_14992.3_y_21970.3_z_4344.8.tiff";
+    constexpr auto obj = "../tmp/seg_ImgSoma_17302_00020-x_14992.3_y_21970.3_z_4344.8.obj";
+
+    // the volume is never held whole, only the mesh chunks are collected
+    auto imgFilePath = std::filesystem::current_path().append(img);
+    mesh::Mesh<float> mesh;
+    util::run_with_duration(
+        "Stream mesh", [&imgFilePath, &mesh]()
+        { marching_cubes::extract_from_tiff<float>(
+              imgFilePath, 0.5, 5, 32, [&mesh](const auto &chunk)
+              {
+                  mesh.vertices.insert(mesh.vertices.end(), chunk.vertices.begin(), chunk.vertices.end());
+                  mesh.faces.insert(mesh.faces.end(), chunk.faces.begin(), chunk.faces.end()); }); });
+
+    util::run_with_duration(
+        "Simplify mesh", [&mesh]()
+        { return quadric_error_metrics::simplify(mesh, 0.3); });
+
+    auto objFilePath = std::filesystem::current_path().append(obj);
+    obj::save<float>(objFilePath, mesh);
+}
+
+void extract_soma_mesh_quantized()
+{
+    constexpr auto img = "../data/seg_ImgSoma_17302_00020-x_14992.3_y_21970.3_z_4344.8.tiff";
+    constexpr auto obj = "../tmp/seg_ImgSoma_17302_00020-x_14992.3_y_21970.3_z_4344.8_u8.obj";
+
+    // voxels stay 8 bit all the way, the isovalue is scaled to them instead
+    auto imgFilePath = std::filesystem::current_path().append(img);
+    auto voxelsRaw = util::run_with_duration(
+        "Read voxels", [&imgFilePath]()
+        { return voxel::read_raw_from_tiff<uint8_t>(imgFilePath, util::hardware_threads()); });
+
+    auto voxels = util::run_with_duration(
+        "Smooth voxels", [](const auto &voxels)
+        { return voxel::smooth<uint8_t, 5>(voxels, voxel::Border::clamp, util::hardware_threads()); },
+        voxelsRaw);
+
+    auto mesh = util::run_with_duration(
+        "Extract mesh", [](const auto &voxels)
+        { return marching_cubes::extract<uint8_t>(voxels, voxel::scale_isovalue<uint8_t>(0.5), util::hardware_threads()); },
+        voxels);
+
+    util::run_with_duration(
+        "Simplify mesh", [&mesh]()
+        { return quadric_error_metrics::simplify(mesh, 0.3); });
+
+    auto objFilePath = std::filesystem::current_path().append(obj);
+    obj::save<float>(objFilePath, mesh);
+}
+
+void check_streaming_borders()
+{
+    constexpr auto img = "../tmp/randomStack.tiff";
+    constexpr int X = 12, Y = 9, Z = 10;
+
+    // uniform noise, so the surface also crosses the first and last pages
+    // where the smoothing window wraps through the border
+    auto imgFilePath = std::filesystem::current_path().append(img).string();
+    std::mt19937 random(17302);
+    std::vector<uint8_t> row(Z);
+    TIFF *tif = TIFFOpen(imgFilePath.c_str(), "w");
+    for (int x = 0; x < X; x++)
+    {
+        TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, Z);
+        TIFFSetField(tif, TIFFTAG_IMAGELENGTH, Y);
+        TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+        TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+        TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+        TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+        TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, Y);
+        for (int y = 0; y < Y; y++)
+        {
+            for (auto &v : row)
+                v = random() & 0xff;
+
+            TIFFWriteScanline(tif, row.data(), y, 0);
+        }
+
+        TIFFWriteDirectory(tif);
+    }
+    TIFFClose(tif);
+
+    // streaming has to give the mesh of the in-core path for every size and border
+    const auto voxelsRaw = voxel::read_from_tiff<float>(imgFilePath);
+    for (auto border : {voxel::Border::clamp, voxel::Border::mirror})
+        for (int size = 2; size <= 8; size++)
+        {
+            const auto expected = marching_cubes::extract<float>(voxel::smooth<float>(voxelsRaw, size, border), 0.5);
+
+            mesh::Mesh<float> mesh;
+            marching_cubes::extract_from_tiff<float>(
+                imgFilePath, 0.5, size, 4, [&mesh](const auto &chunk)
+                {
+                    mesh.vertices.insert(mesh.vertices.end(), chunk.vertices.begin(), chunk.vertices.end());
+                    mesh.faces.insert(mesh.faces.end(), chunk.faces.begin(), chunk.faces.end()); },
+                border);
+
+            bool same = mesh.vertices.size() == expected.vertices.size() && mesh.faces.size() == expected.faces.size();
+            for (std::size_t i = 0; same && i < mesh.faces.size(); i++)
+                for (int k = 0; k < 3; k++)
+                    same = same && mesh.faces[i][k] == expected.faces[i][k];
+
+            for (std::size_t i = 0; same && i < mesh.vertices.size(); i++)
+                for (int k = 0; k < 3; k++)
+                    same = same && std::abs(mesh.vertices[i].coord[k] - expected.vertices[i].coord[k]) < 1e-5f;
+
+            std::cout << (border == voxel::Border::mirror ? "mirror" : "clamp ") << ", size " << size << ": "
+                      << mesh.faces.size() << " vs " << expected.faces.size() << " faces, "
+                      << (same ? "same mesh" : "MISMATCH") << std::endl;
+        }
 }
 
 void simplify_test_mesh()
@@ -107,7 +243,7 @@ void simplify_human_mesh()
     constexpr auto in = "../data/FinalBaseMesh.obj";
     constexpr auto out = "../tmp/FinalBaseMesh.obj";
     auto filePath = std::filesystem::current_path().append(in);
-    auto mesh = obj::read(filePath);
+    auto mesh = obj::read(filePath, util::hardware_threads());
 
     util::run_with_duration(
         "Simplify mesh", [&mesh]()
@@ -116,3 +252,87 @@ void simplify_human_mesh()
     auto objFilePath = std::filesystem::current_path().append(out);
     obj::save<float>(objFilePath, mesh);
 }
+
+// obj::save as it was before formatting with std::to_chars, kept to compare against
+template <typename T>
+void save_obj_iostream(const std::string &filePath, const mesh::Mesh<T> &mesh)
+{
+    std::ofstream stream;
+    stream.open(filePath, std::ios::out);
+
+    stream << "# List of vertices" << std::endl;
+    for (auto &v : mesh.vertices)
+        stream << "v "
+               << std::setprecision(4) << std::setw(7) << v.coord[0] << " "
+               << std::setprecision(4) << std::setw(7) << v.coord[1] << " "
+               << std::setprecision(4) << std::setw(7) << v.coord[2] << std::endl;
+    stream << std::endl;
+
+    stream << "# List of normals" << std::endl;
+    for (auto &v : mesh.vertices)
+        stream << "vn "
+               << std::setprecision(4) << std::setw(7) << v.normal[0] << " "
+               << std::setprecision(4) << std::setw(7) << v.normal[1] << " "
+               << std::setprecision(4) << std::setw(7) << v.normal[2] << std::endl;
+    stream << std::endl;
+
+    stream << "# List of faces" << std::endl;
+    for (auto &f : mesh.faces)
+        stream << "f"
+               << " " << f[0] + 1 << "//" << f[0] + 1
+               << " " << f[1] + 1 << "//" << f[1] + 1
+               << " " << f[2] + 1 << "//" << f[2] + 1
+               << std::endl;
+
+    stream.close();
+}
+
+void benchmark_obj_save()
+{
+    constexpr auto in = "../data/FinalBaseMesh.obj";
+    constexpr auto out = "../tmp/FinalBaseMesh.obj";
+    auto filePath = std::filesystem::current_path().append(in);
+    auto objFilePath = std::filesystem::current_path().append(out);
+    auto mesh = obj::read(filePath, util::hardware_threads());
+
+    util::run_with_duration(
+        "Save obj, iostream", [&objFilePath, &mesh]()
+        { save_obj_iostream<float>(objFilePath, mesh); });
+
+    util::run_with_duration(
+        "Save obj, to_chars", [&objFilePath, &mesh]()
+        { obj::save<float>(objFilePath, mesh); });
+
+    util::run_with_duration(
+        "Save obj, to_chars, 6 digits", [&objFilePath, &mesh]()
+        { obj::save<float>(objFilePath, mesh, 6); });
+}
+
+void benchmark_simplify()
+{
+    constexpr auto img = "../data/seg_ImgSoma_17302_00020-x_14992.3_y_21970.3_z_4344.8.tiff";
+
+    auto imgFilePath = std::filesystem::current_path().append(img);
+    const auto voxels = voxel::smooth<float, 5>(voxel::read_from_tiff<float>(imgFilePath, util::hardware_threads()),
+                                                voxel::Border::clamp, util::hardware_threads());
+    const auto mesh = marching_cubes::extract<float>(voxels, 0.5, util::hardware_threads());
+
+    // batching and accumulated quadrics change the result, each is timed on its own
+    auto run = [&mesh](const std::string &title, const auto &simplify)
+    {
+        auto copy = mesh;
+        util::run_with_duration(title, [&copy, &simplify]()
+                                { simplify(copy); });
+        std::cout << "  " << copy.faces.size() << " faces left of " << mesh.faces.size() << std::endl;
+    };
+
+    run("Simplify mesh, serial", [](mesh::Mesh<float> &mesh)
+        { quadric_error_metrics::simplify(mesh, 0.3); });
+
+    run("Simplify mesh, batches of 1%", [](mesh::Mesh<float> &mesh)
+        { quadric_error_metrics::simplify(mesh, 0.3, util::hardware_threads(), 0.01); });
+
+    run("Simplify mesh, batches of 1%, accumulated quadrics", [](mesh::Mesh<float> &mesh)
+        { quadric_error_metrics::simplify<float, double>(mesh, 0.3, util::hardware_threads(), 0.01,
+                                                         quadric_error_metrics::Quadrics::accumulate); });
+}
@@ -1,10 +1,16 @@
 #pragma once
+#include <algorithm>
 #include <array>
 #include <cmath>
+#include <cstring>
 #include <functional>
 #include <vector>
 #include <memory>
+#include <type_traits>
+#include "marchingCubesClassify.hpp"
 #include "marchingCubesTables.hpp"
+#include "util.hpp"
+#include "BrickIndex.hpp"
 #include "Voxel.hpp"
 #include "Vec.hpp"
 #include "Mesh.hpp"
@@ -15,139 +21,601 @@ namespace marching_cubes
     using mesh::Vertex;
     using vec::Vec3;
 
-    template <typename T>
-    using Vertices = std::array<Vertex<T>, 8>;
+    namespace _private
+    {
+        // vertex type of meshes extracted from T voxels, float for integer voxels
+        template <typename T>
+        using VertexType = std::conditional_t<std::is_floating_point_v<T>, T, float>;
+
+        // isovalue as compared with T voxels, see MarchingCubes::Level
+        template <typename T>
+        using Threshold = std::conditional_t<std::is_floating_point_v<T>, T, long long>;
+    }
 
-    template <typename T>
+    /**
+     * Marching cubes over T voxels producing a mesh of V vertices. Voxels are
+     * classified in their own type, integer voxels against an integer
+     * threshold, and converted to V only for the cubes the surface crosses.
+     */
+    template <typename T, typename V = _private::VertexType<T>>
     class MarchingCubes
     {
     public:
-        MarchingCubes(const voxel::Voxels<T> &voxels, T isovalue);
-        Mesh<T> &run();
+        // bricks is optional, cubes in bricks not straddling isovalue are skipped
+        MarchingCubes(const voxel::VoxelGrid<T> &voxels, V isovalue,
+                      const voxel::BrickIndex<T> *bricks = nullptr);
+        // only cubes with x in [xBegin, xEnd), used to extract one slab
+        MarchingCubes(const voxel::VoxelGrid<T> &voxels, V isovalue, int xBegin, int xEnd,
+                      const voxel::BrickIndex<T> *bricks = nullptr);
+        // one mesh per isovalue, all levels extracted in the same traversal
+        MarchingCubes(const voxel::VoxelGrid<T> &voxels, const std::vector<V> &isovalues, int xBegin, int xEnd,
+                      const voxel::BrickIndex<T> *bricks = nullptr);
+        Mesh<V> &run();
+        int level_count() const { return levels.size(); };
+        Mesh<V> &get_mesh(int level = 0) { return levels[level].mesh; };
+        const Mesh<V> &get_mesh(int level = 0) const { return levels[level].mesh; };
+
+        // index of the vertex on edge (x, y, z, dir) in the mesh of level, -1 if none
+        int edge_vertex(int x, int y, int z, _private::EdgeDir dir, int level = 0) const;
 
     private:
-        const T isovalue;
-        const voxel::Voxels<T> &voxels;
-        Mesh<T> mesh;
-        std::vector<std::vector<std::vector<Vec3<int>>>> vertex_index;
-
-        void calc_voxel(const Vec3<int> &pos);
-        Vertices<T> get_vertices(const Vec3<int> &pos);
-        std::array<int, 12> add_edge_vertices(const Vertices<T> &vertices, int edge);
+        // State of one isovalue. Per grid point caches cover the two planes
+        // x and x + 1 touched by the current cube layer. Plane x lives in half
+        // (x - x_begin) % 2, so advancing a layer only clears the entries
+        // touched in one half.
+        struct Level
+        {
+            V isovalue;
+            // Integer voxels v are below isovalue exactly when v < ceil(isovalue),
+            // kept wider than T so it is exact at both ends of T's range.
+            _private::Threshold<T> threshold;
+            Mesh<V> mesh;
+            // classification of each grid point, value < isovalue
+            std::vector<uint8_t> below_cache;
+            // vertex index of each edge keyed by its min corner
+            std::vector<Vec3<int>> edge_cache;
+            // entries of edge_cache set in each half
+            std::array<std::vector<std::size_t>, 2> touched;
+            // plane x_begin of edge_cache, kept for stitching slabs
+            std::vector<Vec3<int>> lower_plane;
+        };
+
+        const voxel::VoxelGrid<T> &voxels;
+        const int x_begin;
+        const int x_end;
+        const voxel::BrickIndex<T> *bricks;
+        std::vector<Level> levels;
+
+        // current cube layer x, and slices x - 1 .. x + 2 (nullptr outside the grid)
+        int layer_x;
+        std::array<const T *, 4> layer;
+
+        // Normalized gradient, computed on first use by an active edge of
+        // any level, and the entries set in each half
+        std::vector<Vec3<V>> gradient_cache;
+        std::vector<uint8_t> gradient_valid;
+        std::array<std::vector<std::size_t>, 2> gradient_touched;
+        // Value range of each grid row of the planes x and x + 1, shared by
+        // all levels to skip uniform rows. Not kept with bricks, which skip
+        // whole blocks already.
+        std::vector<T> row_min;
+        std::vector<T> row_max;
+
+        // straddling bricks (by, bz) next to the plane or layer being classified
+        std::vector<uint8_t> brick_mask;
+        // case codes of one cube row, and the active cubes of the current layer and level
+        std::vector<uint8_t> codes;
+        std::vector<_private::Cube> active;
+
+        std::size_t plane_offset(int x) const;
+        std::size_t row_offset(int x) const { return ((x - x_begin) & 0x01) * voxels.size(1); };
+        void next_layer(int x);
+        void scan_plane(int x);
+        void classify_plane(Level &level, int x);
+        void classify_layer(const Level &level, int x);
+        void calc_voxel(Level &level, int x, int y, int z, int index);
+        const Vec3<V> &get_gradient(int x, int y, int z);
+        int add_edge_vertex(Level &level, int x, int y, int z, const std::array<V, 8> &val, int edge);
     };
 
-    template <typename T>
-    Mesh<T> extract(const voxel::Voxels<T> &voxels, T isovalue)
+    namespace _private
+    {
+        template <typename T, typename V>
+        std::vector<Mesh<V>> extract_slabs(const voxel::VoxelGrid<T> &voxels, const std::vector<V> &isovalues,
+                                           const voxel::BrickIndex<T> *bricks, int threads);
+
+        template <typename T, typename V>
+        Mesh<V> merge_slabs(const std::vector<std::unique_ptr<MarchingCubes<T, V>>> &slabs,
+                            const std::vector<int> &slabBegin, const Vec3<int> &dims, int level, int threads);
+    }
+
+    /*
+     * The extract functions take T voxels and give V meshes, V is float for
+     * integer voxels. Isovalues are in V and do not take part in deduction,
+     * so extract<uint8_t>(voxels, 127.5) extracts a Mesh<float>.
+     */
+
+    template <typename T, typename V = _private::VertexType<T>>
+    Mesh<V> extract(const voxel::VoxelGrid<T> &voxels, std::type_identity_t<V> isovalue)
     {
-        MarchingCubes<T> alg(voxels, isovalue);
+        MarchingCubes<T, V> alg(voxels, isovalue);
         return std::move(alg.run());
     }
 
-    template <typename T>
-    MarchingCubes<T>::MarchingCubes(const voxel::Voxels<T> &voxels, T isovalue) : voxels(voxels), isovalue(isovalue)
+    /**
+     * Extract in parallel: the volume is cut into x-slabs which are extracted
+     * independently and stitched along the shared planes. The result is
+     * identical to extract(voxels, isovalue), whatever the thread count.
+     */
+    template <typename T, typename V = _private::VertexType<T>>
+    Mesh<V> extract(const voxel::VoxelGrid<T> &voxels, std::type_identity_t<V> isovalue, int threads)
+    {
+        return std::move(_private::extract_slabs<T, V>(voxels, {isovalue}, nullptr, threads)[0]);
+    }
+
+    /**
+     * Extract only from bricks whose value range straddles isovalue, which
+     * makes the cost follow the surface rather than the volume. The same
+     * index serves any isovalue. Output is identical to extract(voxels, isovalue).
+     */
+    template <typename T, typename V = _private::VertexType<T>>
+    Mesh<V> extract(const voxel::VoxelGrid<T> &voxels, std::type_identity_t<V> isovalue, const voxel::BrickIndex<T> &bricks,
+                    int threads = 1)
+    {
+        return std::move(_private::extract_slabs<T, V>(voxels, {isovalue}, &bricks, threads)[0]);
+    }
+
+    /**
+     * Extract one mesh per isovalue in a single traversal of the grid. Slices
+     * are loaded once per layer and gradients are shared by all levels. Mesh
+     * i is identical to extract(voxels, isovalues[i]).
+     */
+    template <typename T, typename V = _private::VertexType<T>>
+    std::vector<Mesh<V>> extract(const voxel::VoxelGrid<T> &voxels, const std::type_identity_t<std::vector<V>> &isovalues,
+                                 int threads = 1)
+    {
+        return _private::extract_slabs<T, V>(voxels, isovalues, nullptr, threads);
+    }
+
+    template <typename T, typename V = _private::VertexType<T>>
+    std::vector<Mesh<V>> extract(const voxel::VoxelGrid<T> &voxels, const std::type_identity_t<std::vector<V>> &isovalues,
+                                 const voxel::BrickIndex<T> &bricks, int threads = 1)
     {
-        // initial vertices, set -1 as default
-        for (auto x = 0; x < voxels.size() - 1; x++)
+        return _private::extract_slabs<T, V>(voxels, isovalues, &bricks, threads);
+    }
+
+    template <typename T, typename V>
+    MarchingCubes<T, V>::MarchingCubes(const voxel::VoxelGrid<T> &voxels, V isovalue,
+                                       const voxel::BrickIndex<T> *bricks)
+        : MarchingCubes(voxels, isovalue, 0, voxels.size(0) - 1, bricks){};
+
+    template <typename T, typename V>
+    MarchingCubes<T, V>::MarchingCubes(const voxel::VoxelGrid<T> &voxels, V isovalue, int xBegin, int xEnd,
+                                       const voxel::BrickIndex<T> *bricks)
+        : MarchingCubes(voxels, std::vector<V>{isovalue}, xBegin, xEnd, bricks){};
+
+    template <typename T, typename V>
+    MarchingCubes<T, V>::MarchingCubes(const voxel::VoxelGrid<T> &voxels, const std::vector<V> &isovalues,
+                                       int xBegin, int xEnd, const voxel::BrickIndex<T> *bricks)
+        : voxels(voxels), x_begin(xBegin), x_end(xEnd), bricks(bricks), levels(isovalues.size())
+    {
+        // initial vertices, set -1 as default. Edges on the far faces of a
+        // cube start at its max corner, so one entry per grid point.
+        const auto planeSize = static_cast<std::size_t>(voxels.size(1)) * voxels.size(2);
+        for (std::size_t i = 0; i < isovalues.size(); i++)
         {
-            std::vector<std::vector<Vec3<int>>> vv;
-            for (auto y = 0; y < voxels[0].size() - 1; y++)
-            {
-                std::vector<Vec3<int>> v;
-                for (auto z = 0; z < voxels[0][0].size() - 1; z++)
-                    v.emplace_back(Vec3<int>{-1, -1, -1});
+            levels[i].isovalue = isovalues[i];
+            if constexpr (std::is_floating_point_v<T>)
+                levels[i].threshold = isovalues[i];
+            else
+                levels[i].threshold = std::ceil(isovalues[i]);
+
+            levels[i].below_cache.resize(2 * planeSize);
+            levels[i].edge_cache.assign(2 * planeSize, Vec3<int>{-1, -1, -1});
+        }
 
-                vv.emplace_back(v);
+        codes.resize(std::max(0, voxels.size(2) - 1));
+        gradient_cache.resize(2 * planeSize);
+        gradient_valid.assign(2 * planeSize, 0);
+        if (bricks == nullptr)
+        {
+            row_min.resize(2 * voxels.size(1));
+            row_max.resize(2 * voxels.size(1));
+        }
+    }
+
+    template <typename T, typename V>
+    std::size_t MarchingCubes<T, V>::plane_offset(int x) const
+    {
+        return ((x - x_begin) & 0x01) * (gradient_cache.size() / 2);
+    }
+
+    template <typename T, typename V>
+    int MarchingCubes<T, V>::edge_vertex(int x, int y, int z, _private::EdgeDir dir, int level) const
+    {
+        // only the boundary planes x_begin and x_end are still known after run()
+        const auto &l = levels[level];
+        const auto i = static_cast<std::size_t>(y) * voxels.size(2) + z;
+        const auto &index = x == x_begin && !l.lower_plane.empty() ? l.lower_plane[i] : l.edge_cache[plane_offset(x) + i];
+        return index[static_cast<int>(dir)];
+    }
+
+    template <typename T, typename V>
+    Mesh<V> &MarchingCubes<T, V>::run()
+    {
+        // levels run back to back on each layer, so they find its slices
+        // and gradients still in cache
+        for (auto x = x_begin; x < x_end; x++)
+        {
+            next_layer(x);
+            for (auto &level : levels)
+            {
+                classify_layer(level, x);
+                for (const auto &cube : active)
+                    calc_voxel(level, x, cube.y, cube.z, cube.index);
             }
+        }
+
+        return levels[0].mesh;
+    }
+
+    template <typename T, typename V>
+    void MarchingCubes<T, V>::next_layer(int x)
+    {
+        const auto planeSize = gradient_cache.size() / 2;
+        // plane x + 1 still holds plane x - 1
+        const auto half = (x + 1 - x_begin) & 0x01;
+        for (auto &level : levels)
+        {
+            if (x == x_begin + 1)
+                level.lower_plane.assign(level.edge_cache.begin() + plane_offset(x_begin),
+                                         level.edge_cache.begin() + plane_offset(x_begin) + planeSize);
+
+            for (auto i : level.touched[half])
+                level.edge_cache[i] = Vec3<int>{-1, -1, -1};
+
+            level.touched[half].clear();
+        }
+
+        for (auto i : gradient_touched[half])
+            gradient_valid[i] = 0;
+
+        gradient_touched[half].clear();
+
+        const auto X = voxels.size(0);
+        layer_x = x;
+        layer = {x > 0 ? voxels.slice(x - 1) : nullptr,
+                 voxels.slice(x),
+                 voxels.slice(x + 1),
+                 x + 2 < X ? voxels.slice(x + 2) : nullptr};
+
+        // plane x was scanned and classified by the previous layer
+        if (bricks == nullptr)
+        {
+            if (x == x_begin)
+                scan_plane(x);
+
+            scan_plane(x + 1);
+        }
+
+        for (auto &level : levels)
+        {
+            if (x == x_begin)
+                classify_plane(level, x);
 
-            vertex_index.emplace_back(vv);
+            classify_plane(level, x + 1);
         }
     }
 
-    template <typename T>
-    Mesh<T> &MarchingCubes<T>::run()
+    template <typename T, typename V>
+    void MarchingCubes<T, V>::scan_plane(int x)
     {
-        // TODO[feat]: support async
-        for (auto x = 0; x < voxels.size() - 1; x++)
-            for (auto y = 0; y < voxels[0].size() - 1; y++)
-                for (auto z = 0; z < voxels[0][0].size() - 1; z++)
-                    calc_voxel({x, y, z});
+        const auto Y = voxels.size(1);
+        const auto Z = voxels.size(2);
+        const auto *slice = layer[1 + x - layer_x];
+        auto *lo = row_min.data() + row_offset(x);
+        auto *hi = row_max.data() + row_offset(x);
+        for (int y = 0; y < Y; y++)
+        {
+            const auto *row = slice + static_cast<std::size_t>(y) * Z;
+            lo[y] = hi[y] = row[0];
+            _private::row_range(row, Z, lo[y], hi[y]);
+        }
+    }
+
+    template <typename T, typename V>
+    void MarchingCubes<T, V>::classify_plane(Level &level, int x)
+    {
+        // Without bricks each row is classified whole. With bricks only the
+        // runs of straddling bricks of the layers x - 1 and x are, the rest
+        // keeps stale values that classify_layer never reads.
+        const auto X = voxels.size(0);
+        const auto Y = voxels.size(1);
+        const auto Z = voxels.size(2);
+        const auto isovalue = level.threshold;
+        auto *below = level.below_cache.data() + plane_offset(x);
+        const auto *slice = layer[1 + x - layer_x];
+        // only rows and bricks straddling the threshold get here, so it fits in T
+        auto classify = [&](int y, int z0, int z1)
+        {
+            const auto row = static_cast<std::size_t>(y) * Z;
+            _private::classify_row(slice + row + z0, z1 - z0, static_cast<T>(isovalue), below + row + z0);
+        };
+
+        if (bricks == nullptr)
+        {
+            // rows entirely on one side are filled without reading the slice
+            const auto *lo = row_min.data() + row_offset(x);
+            const auto *hi = row_max.data() + row_offset(x);
+            for (int y = 0; y < Y; y++)
+                if (hi[y] < isovalue)
+                    std::memset(below + static_cast<std::size_t>(y) * Z, 0x01, Z);
+                else if (!(lo[y] < isovalue))
+                    std::memset(below + static_cast<std::size_t>(y) * Z, 0x00, Z);
+                else
+                    classify(y, 0, Z);
+
+            return;
+        }
+
+        const auto size = bricks->brick_size();
+        const auto &n = bricks->dims();
+        brick_mask.assign(static_cast<std::size_t>(n[1]) * n[2], 0);
+        for (auto cx : {x - 1, x})
+            if (cx >= 0 && cx < X - 1)
+                for (int by = 0; by < n[1]; by++)
+                    for (int bz = 0; bz < n[2]; bz++)
+                        brick_mask[by * n[2] + bz] |= bricks->straddles(cx / size, by, bz, isovalue);
+
+        for (int y = 0; y < Y; y++)
+        {
+            // grid row y is shared by the cube rows y - 1 and y
+            const auto by1 = std::min(y / size, n[1] - 1);
+            const auto by0 = y > 0 ? (y - 1) / size : by1;
+            _private::for_each_run(brick_mask.data() + by0 * n[2], brick_mask.data() + by1 * n[2], n[2],
+                                   [&](int bz0, int bz1)
+                                   { classify(y, bz0 * size, std::min(bz1 * size, Z - 1) + 1); });
+        }
+    }
 
-        return mesh;
+    template <typename T, typename V>
+    void MarchingCubes<T, V>::classify_layer(const Level &level, int x)
+    {
+        // case codes from the two classified planes, row by row, compacted
+        // to the cubes the surface actually passes through
+        const auto Y = voxels.size(1);
+        const auto Z = voxels.size(2);
+        const auto *below0 = level.below_cache.data() + plane_offset(x);
+        const auto *below1 = level.below_cache.data() + plane_offset(x + 1);
+        auto combine = [&](int y, int z0, int z1)
+        {
+            const auto row0 = static_cast<std::size_t>(y) * Z;
+            const auto row1 = row0 + Z;
+            _private::combine_rows(below0 + row0, below1 + row0, below1 + row1, below0 + row1, z0, z1, codes.data());
+            _private::compact_active(codes.data(), z0, z1, y, active);
+        };
+
+        active.clear();
+        if (bricks == nullptr)
+        {
+            // a cube row is active only if its four grid rows straddle isovalue
+            const auto *lo0 = row_min.data() + row_offset(x);
+            const auto *lo1 = row_min.data() + row_offset(x + 1);
+            const auto *hi0 = row_max.data() + row_offset(x);
+            const auto *hi1 = row_max.data() + row_offset(x + 1);
+            for (int y = 0; y < Y - 1; y++)
+            {
+                const auto lo = std::min({lo0[y], lo0[y + 1], lo1[y], lo1[y + 1]});
+                const auto hi = std::max({hi0[y], hi0[y + 1], hi1[y], hi1[y + 1]});
+                if (lo < level.threshold && !(hi < level.threshold))
+                    combine(y, 0, Z - 1);
+            }
+
+            return;
+        }
+
+        const auto size = bricks->brick_size();
+        const auto &n = bricks->dims();
+        brick_mask.resize(static_cast<std::size_t>(n[1]) * n[2]);
+        for (int by = 0; by < n[1]; by++)
+            for (int bz = 0; bz < n[2]; bz++)
+                brick_mask[by * n[2] + bz] = bricks->straddles(x / size, by, bz, level.threshold);
+
+        for (int y = 0; y < Y - 1; y++)
+        {
+            const auto *mask = brick_mask.data() + y / size * n[2];
+            _private::for_each_run(mask, mask, n[2],
+                                   [&](int bz0, int bz1)
+                                   { combine(y, bz0 * size, std::min(bz1 * size, Z - 1)); });
+        }
     }
 
-    template <typename T>
-    void MarchingCubes<T>::calc_voxel(const Vec3<int> &pos)
+    template <typename T, typename V>
+    void MarchingCubes<T, V>::calc_voxel(Level &level, int x, int y, int z, int index)
     {
-        auto v = get_vertices(pos);
-        auto index = 0;
+        const auto Z = voxels.size(2);
+        std::array<V, 8> val;
         for (auto i = 0; i < 8; i++)
-            index |= v[i].val < isovalue ? (0x01 << i) : 0x00;
+        {
+            const auto &[ox, oy, oz] = _private::vertex_offsets[i];
+            val[i] = static_cast<V>(layer[1 + ox][static_cast<std::size_t>(y + oy) * Z + z + oz]);
+        }
 
         const auto edge = _private::edge_table[index];
-        if (edge == 0)
-            return;
+
+        std::array<int, 12> points;
+        for (auto i = 0; i < 12; i++)
+            if (((edge >> i) & 0x01) != 0x00)
+                points[i] = add_edge_vertex(level, x, y, z, val, i);
 
         const auto &triangle = _private::triangle_table[index];
-        const auto points = add_edge_vertices(v, edge);
         for (auto i = 0; triangle[i] != -1; i += 3)
-            mesh.faces.emplace_back(Vec3<int>{
+            level.mesh.faces.emplace_back(Vec3<int>{
                 points[triangle[i + 0]],
                 points[triangle[i + 1]],
                 points[triangle[i + 2]]});
     }
 
-    template <typename T>
-    Vertices<T> MarchingCubes<T>::get_vertices(const Vec3<int> &pos)
+    template <typename T, typename V>
+    const Vec3<V> &MarchingCubes<T, V>::get_gradient(int x, int y, int z)
     {
-        Vertices<T> v;
-        for (auto i = 0; i < 8; i++)
+        const auto i = plane_offset(x) + static_cast<std::size_t>(y) * voxels.size(2) + z;
+        if (!gradient_valid[i])
         {
-            const auto &[ox, oy, oz] = _private::vertex_offsets[i];
-            const auto x = pos[0] + ox;
-            const auto y = pos[1] + oy;
-            const auto z = pos[2] + oz;
-            v[i] = Vertex<T>{
-                val : voxels[x][y][z],
-                coord : Vec3<T>{static_cast<T>(x), static_cast<T>(y), static_cast<T>(z)},
-                normal : voxel::get_normal<T>(voxels, x, y, z)
-            };
+            const auto k = x - layer_x;
+            gradient_cache[i] = voxel::get_normal<T, V>(layer[k], layer[k + 1], layer[k + 2],
+                                                        voxels.size(1), voxels.size(2), y, z, voxels.spacing);
+            gradient_valid[i] = 1;
+            gradient_touched[(x - x_begin) & 0x01].emplace_back(i);
         }
 
-        return v;
+        return gradient_cache[i];
     }
 
-    template <typename T>
-    std::array<int, 12> MarchingCubes<T>::add_edge_vertices(const Vertices<T> &vertices, int edge)
+    template <typename T, typename V>
+    int MarchingCubes<T, V>::add_edge_vertex(Level &level, int x, int y, int z, const std::array<V, 8> &val, int edge)
     {
-        std::array<int, 12> points;
-        for (auto i = 0; i < 12; i++)
+        const auto &[a, b, dir] = _private::edge_connection[edge];
+        const auto &[ax, ay, az] = _private::vertex_offsets[a];
+        const auto &[bx, by, bz] = _private::vertex_offsets[b];
+
+        const auto i = plane_offset(x + std::min(ax, bx)) + static_cast<std::size_t>(y + std::min(ay, by)) * voxels.size(2) + z + std::min(az, bz);
+        auto &index = level.edge_cache[i][static_cast<int>(dir)];
+        if (index == -1)
         {
-            if (((edge >> i) & 0x01) == 0x00)
-                continue;
+            level.touched[(x + std::min(ax, bx) - x_begin) & 0x01].emplace_back(i);
+            const auto isovalue = level.isovalue;
+            const Vec3<V> ca{static_cast<V>(x + ax), static_cast<V>(y + ay), static_cast<V>(z + az)};
+            const Vec3<V> cb{static_cast<V>(x + bx), static_cast<V>(y + by), static_cast<V>(z + bz)};
+            const double interpolation = (isovalue - val[a]) / (val[b] - val[a]);
+            auto coord = vec::interpolate(interpolation, ca, cb);
+            auto normal = vec::interpolate(interpolation,
+                                           get_gradient(x + ax, y + ay, z + az),
+                                           get_gradient(x + bx, y + by, z + bz));
+
+            index = level.mesh.vertices.size();
+            level.mesh.vertices.emplace_back(Vertex<V>{
+                val : isovalue,
+                coord : voxels.to_world(coord),
+                normal : vec::normalize(normal)
+            });
+        }
 
-            const auto &[a, b, dir] = _private::edge_connection[i];
-            const auto &va = vertices[a];
-            const auto &vb = vertices[b];
+        return index;
+    };
 
-            const auto min = vec::min<T>(va.coord, vb.coord);
-            auto &index = vertex_index[min[0]][min[1]][min[2]][static_cast<int>(dir)];
-            if (index == -1)
+    namespace _private
+    {
+        template <typename T, typename V>
+        std::vector<Mesh<V>> extract_slabs(const voxel::VoxelGrid<T> &voxels, const std::vector<V> &isovalues,
+                                           const voxel::BrickIndex<T> *bricks, int threads)
+        {
+            const int cubes = voxels.size(0) - 1;
+            const int levelN = isovalues.size();
+            std::vector<Mesh<V>> meshes(levelN);
+            if (threads <= 1 || cubes < 2)
             {
-                auto coord = vec::interpolate<T>(isovalue, va.val, vb.val, va.coord, vb.coord);
-                auto normal = vec::interpolate<T>(isovalue, va.normal, vb.normal);
-
-                // TODO[feat]: support async
-                index = mesh.vertices.size();
-                mesh.vertices.emplace_back(Vertex<T>{
-                    val : isovalue,
-                    coord : coord,
-                    normal : vec::normalize(normal)
-                });
+                MarchingCubes<T, V> alg(voxels, isovalues, 0, std::max(cubes, 0), bricks);
+                alg.run();
+                for (int l = 0; l < levelN; l++)
+                    meshes[l] = std::move(alg.get_mesh(l));
+
+                return meshes;
             }
 
-            points[i] = index;
+            // a few slabs per thread to balance uneven surface density
+            const int slabN = std::min(cubes, threads * 4);
+            std::vector<int> slabBegin(slabN + 1);
+            for (int i = 0; i <= slabN; i++)
+                slabBegin[i] = static_cast<long>(cubes) * i / slabN;
+
+            std::vector<std::unique_ptr<MarchingCubes<T, V>>> slabs(slabN);
+            util::parallel_for(slabN, threads, [&](int i)
+                               {
+                                   slabs[i] = std::make_unique<MarchingCubes<T, V>>(voxels, isovalues, slabBegin[i], slabBegin[i + 1], bricks);
+                                   slabs[i]->run(); });
+
+            for (int l = 0; l < levelN; l++)
+                meshes[l] = merge_slabs(slabs, slabBegin, voxels.dims(), l, threads);
+
+            return meshes;
         }
 
-        return std::move(points);
-    };
+        template <typename T, typename V>
+        Mesh<V> merge_slabs(const std::vector<std::unique_ptr<MarchingCubes<T, V>>> &slabs,
+                            const std::vector<int> &slabBegin, const Vec3<int> &dims, int level, int threads)
+        {
+            // Vertices on the plane between two slabs are created by both. The copy
+            // in the lower slab is created first in a serial run, so it is kept and
+            // the upper slab's copy is mapped onto it; every other vertex keeps its
+            // relative order. rank[s][i] is the order of vertex i among the vertices
+            // kept by slab s, or -1 for a vertex owned by slab s - 1.
+            const int slabN = slabs.size();
+            std::vector<std::vector<int>> rank(slabN);
+            std::vector<int> vertexCount(slabN + 1, 0);
+            std::vector<int> faceCount(slabN + 1, 0);
+            util::parallel_for(slabN, threads, [&](int s)
+                               {
+                                   const auto &m = slabs[s]->get_mesh(level);
+                                   auto &r = rank[s];
+                                   r.assign(m.vertices.size(), 0);
+                                   if (s > 0)
+                                       for (int y = 0; y < dims[1]; y++)
+                                           for (int z = 0; z < dims[2]; z++)
+                                               for (auto dir : {EdgeDir::y, EdgeDir::z})
+                                               {
+                                                   auto i = slabs[s]->edge_vertex(slabBegin[s], y, z, dir, level);
+                                                   if (i != -1)
+                                                       r[i] = -1;
+                                               }
+
+                                   int n = 0;
+                                   for (auto &k : r)
+                                       k = k == -1 ? -1 : n++;
+
+                                   vertexCount[s + 1] = n;
+                                   faceCount[s + 1] = m.faces.size(); });
+
+            for (int s = 0; s < slabN; s++)
+            {
+                vertexCount[s + 1] += vertexCount[s];
+                faceCount[s + 1] += faceCount[s];
+            }
+
+            Mesh<V> mesh;
+            mesh.vertices.resize(vertexCount[slabN]);
+            mesh.faces.resize(faceCount[slabN]);
+            util::parallel_for(slabN, threads, [&](int s)
+                               {
+                                   const auto &m = slabs[s]->get_mesh(level);
+                                   std::vector<int> index(m.vertices.size());
+                                   for (std::size_t i = 0; i < m.vertices.size(); i++)
+                                       if (rank[s][i] != -1)
+                                       {
+                                           index[i] = vertexCount[s] + rank[s][i];
+                                           mesh.vertices[index[i]] = m.vertices[i];
+                                       }
+
+                                   if (s > 0)
+                                       for (int y = 0; y < dims[1]; y++)
+                                           for (int z = 0; z < dims[2]; z++)
+                                               for (auto dir : {EdgeDir::y, EdgeDir::z})
+                                               {
+                                                   auto i = slabs[s]->edge_vertex(slabBegin[s], y, z, dir, level);
+                                                   if (i != -1)
+                                                   {
+                                                       auto j = slabs[s - 1]->edge_vertex(slabBegin[s], y, z, dir, level);
+                                                       index[i] = vertexCount[s - 1] + rank[s - 1][j];
+                                                   }
+                                               }
+
+                                   for (std::size_t i = 0; i < m.faces.size(); i++)
+                                   {
+                                       const auto &f = m.faces[i];
+                                       mesh.faces[faceCount[s] + i] = Vec3<int>{index[f[0]], index[f[1]], index[f[2]]};
+                                   } });
+
+            return mesh;
+        }
+    }
 }
@@ -0,0 +1,612 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+#include "util.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MARCHING_CUBES_X86
+#endif
+
+namespace marching_cubes
+{
+    namespace _private
+    {
+        // An active cube of the current layer, index is its case code
+        struct Cube
+        {
+            int y;
+            int z;
+            int index;
+        };
+
+        // f(begin, end) for every run of consecutive i with m0[i] | m1[i] set
+        template <typename F>
+        void for_each_run(const uint8_t *m0, const uint8_t *m1, int n, const F &f)
+        {
+            for (int i = 0; i < n;)
+            {
+                if (!(m0[i] | m1[i]))
+                {
+                    i++;
+                    continue;
+                }
+
+                int j = i + 1;
+                while (j < n && (m0[j] | m1[j]))
+                    j++;
+
+                f(i, j);
+                i = j;
+            }
+        }
+
+        // expand the low N bits of a compare mask into N bytes of 0 / 1
+        template <typename U, int N>
+        constexpr std::array<U, (1 << N)> generate_mask_expansion()
+        {
+            std::array<U, (1 << N)> table{};
+            for (int m = 0; m < (1 << N); m++)
+                for (int j = 0; j < N; j++)
+                    table[m] |= static_cast<U>((m >> j) & 0x01) << (8 * j);
+
+            return table;
+        }
+
+        constexpr auto expand_mask8 = generate_mask_expansion<uint64_t, 8>();
+        constexpr auto expand_mask4 = generate_mask_expansion<uint32_t, 4>();
+
+        /*
+         * Scalar kernels, also used for the tails of the SIMD ones.
+         */
+
+        template <typename T>
+        inline void classify_row_scalar(const T *row, int begin, int end, T isovalue, uint8_t *below)
+        {
+            for (int i = begin; i < end; i++)
+                below[i] = row[i] < isovalue ? 0x01 : 0x00;
+        }
+
+        template <typename T>
+        inline void row_range_scalar(const T *row, int begin, int end, T &lo, T &hi)
+        {
+            for (int i = begin; i < end; i++)
+            {
+                lo = row[i] < lo ? row[i] : lo;
+                hi = hi < row[i] ? row[i] : hi;
+            }
+        }
+
+        inline void combine_rows_scalar(const uint8_t *b0, const uint8_t *b1, const uint8_t *b2, const uint8_t *b3,
+                                        int begin, int end, uint8_t *codes)
+        {
+            for (int i = begin; i < end; i++)
+            {
+                const int s0 = b0[i] | (b1[i] << 1) | (b2[i] << 2) | (b3[i] << 3);
+                const int s1 = b0[i + 1] | (b1[i + 1] << 1) | (b2[i + 1] << 2) | (b3[i + 1] << 3);
+                codes[i] = static_cast<uint8_t>(s0 | (s1 << 4));
+            }
+        }
+
+        inline void compact_active_scalar(const uint8_t *codes, int begin, int end, int y, std::vector<Cube> &active)
+        {
+            for (int i = begin; i < end; i++)
+                if (codes[i] != 0x00 && codes[i] != 0xff)
+                    active.emplace_back(Cube{y, i, codes[i]});
+        }
+
+#ifdef MARCHING_CUBES_X86
+        /*
+         * SSE2 kernels
+         */
+
+        __attribute__((target("sse2"))) inline void classify_row_sse2(const float *row, int n, float isovalue, uint8_t *below)
+        {
+            const auto iso = _mm_set1_ps(isovalue);
+            int i = 0;
+            for (; i + 4 <= n; i += 4)
+            {
+                const auto mask = _mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(row + i), iso));
+                std::memcpy(below + i, &expand_mask4[mask], 4);
+            }
+
+            classify_row_scalar(row, i, n, isovalue, below);
+        }
+
+        __attribute__((target("sse2"))) inline void classify_row_sse2(const double *row, int n, double isovalue, uint8_t *below)
+        {
+            const auto iso = _mm_set1_pd(isovalue);
+            int i = 0;
+            for (; i + 2 <= n; i += 2)
+            {
+                const auto mask = _mm_movemask_pd(_mm_cmplt_pd(_mm_loadu_pd(row + i), iso));
+                std::memcpy(below + i, &expand_mask4[mask], 2);
+            }
+
+            classify_row_scalar(row, i, n, isovalue, below);
+        }
+
+        __attribute__((target("sse2"))) inline void row_range_sse2(const float *row, int n, float &lo, float &hi)
+        {
+            if (n < 4)
+                return row_range_scalar(row, 0, n, lo, hi);
+
+            auto vlo = _mm_loadu_ps(row);
+            auto vhi = vlo;
+            int i = 4;
+            for (; i + 4 <= n; i += 4)
+            {
+                const auto v = _mm_loadu_ps(row + i);
+                vlo = _mm_min_ps(vlo, v);
+                vhi = _mm_max_ps(vhi, v);
+            }
+
+            alignas(16) float l[4], h[4];
+            _mm_store_ps(l, vlo);
+            _mm_store_ps(h, vhi);
+            row_range_scalar(l, 0, 4, lo, hi);
+            row_range_scalar(h, 0, 4, lo, hi);
+            row_range_scalar(row, i, n, lo, hi);
+        }
+
+        __attribute__((target("sse2"))) inline void row_range_sse2(const double *row, int n, double &lo, double &hi)
+        {
+            if (n < 2)
+                return row_range_scalar(row, 0, n, lo, hi);
+
+            auto vlo = _mm_loadu_pd(row);
+            auto vhi = vlo;
+            int i = 2;
+            for (; i + 2 <= n; i += 2)
+            {
+                const auto v = _mm_loadu_pd(row + i);
+                vlo = _mm_min_pd(vlo, v);
+                vhi = _mm_max_pd(vhi, v);
+            }
+
+            alignas(16) double l[2], h[2];
+            _mm_store_pd(l, vlo);
+            _mm_store_pd(h, vhi);
+            row_range_scalar(l, 0, 2, lo, hi);
+            row_range_scalar(h, 0, 2, lo, hi);
+            row_range_scalar(row, i, n, lo, hi);
+        }
+
+        // Integer kernels. SSE2 has no unsigned 16-bit compare or min / max,
+        // flipping the sign bit maps them onto the signed ones.
+
+        // widen [lo, hi] by the lanes of vlo / vhi, folded in halves down to lane 0
+        __attribute__((target("sse2"))) inline void range_epu8_sse2(__m128i vlo, __m128i vhi, uint8_t &lo, uint8_t &hi)
+        {
+            vlo = _mm_min_epu8(vlo, _mm_srli_si128(vlo, 8));
+            vhi = _mm_max_epu8(vhi, _mm_srli_si128(vhi, 8));
+            vlo = _mm_min_epu8(vlo, _mm_srli_si128(vlo, 4));
+            vhi = _mm_max_epu8(vhi, _mm_srli_si128(vhi, 4));
+            vlo = _mm_min_epu8(vlo, _mm_srli_si128(vlo, 2));
+            vhi = _mm_max_epu8(vhi, _mm_srli_si128(vhi, 2));
+            vlo = _mm_min_epu8(vlo, _mm_srli_si128(vlo, 1));
+            vhi = _mm_max_epu8(vhi, _mm_srli_si128(vhi, 1));
+            const auto l = static_cast<uint8_t>(_mm_cvtsi128_si32(vlo));
+            const auto h = static_cast<uint8_t>(_mm_cvtsi128_si32(vhi));
+            lo = l < lo ? l : lo;
+            hi = hi < h ? h : hi;
+        }
+
+        // as above for 16-bit lanes with flipped sign bits
+        __attribute__((target("sse2"))) inline void range_epi16_sse2(__m128i vlo, __m128i vhi, __m128i flip, uint16_t &lo, uint16_t &hi)
+        {
+            vlo = _mm_min_epi16(vlo, _mm_srli_si128(vlo, 8));
+            vhi = _mm_max_epi16(vhi, _mm_srli_si128(vhi, 8));
+            vlo = _mm_min_epi16(vlo, _mm_srli_si128(vlo, 4));
+            vhi = _mm_max_epi16(vhi, _mm_srli_si128(vhi, 4));
+            vlo = _mm_min_epi16(vlo, _mm_srli_si128(vlo, 2));
+            vhi = _mm_max_epi16(vhi, _mm_srli_si128(vhi, 2));
+            const auto l = static_cast<uint16_t>(_mm_cvtsi128_si32(_mm_xor_si128(vlo, flip)));
+            const auto h = static_cast<uint16_t>(_mm_cvtsi128_si32(_mm_xor_si128(vhi, flip)));
+            lo = l < lo ? l : lo;
+            hi = hi < h ? h : hi;
+        }
+
+        __attribute__((target("sse2"))) inline void classify_row_sse2(const uint8_t *row, int n, uint8_t isovalue, uint8_t *below)
+        {
+            const auto iso = _mm_set1_epi8(static_cast<char>(isovalue));
+            const auto one = _mm_set1_epi8(0x01);
+            int i = 0;
+            for (; i + 16 <= n; i += 16)
+            {
+                const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i));
+                const auto notBelow = _mm_cmpeq_epi8(_mm_max_epu8(v, iso), v);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(below + i), _mm_andnot_si128(notBelow, one));
+            }
+
+            classify_row_scalar(row, i, n, isovalue, below);
+        }
+
+        __attribute__((target("sse2"))) inline void classify_row_sse2(const uint16_t *row, int n, uint16_t isovalue, uint8_t *below)
+        {
+            const auto flip = _mm_set1_epi16(static_cast<short>(0x8000));
+            const auto iso = _mm_xor_si128(_mm_set1_epi16(static_cast<short>(isovalue)), flip);
+            const auto one = _mm_set1_epi8(0x01);
+            int i = 0;
+            for (; i + 16 <= n; i += 16)
+            {
+                const auto v0 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i)), flip);
+                const auto v1 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i + 8)), flip);
+                const auto mask = _mm_packs_epi16(_mm_cmplt_epi16(v0, iso), _mm_cmplt_epi16(v1, iso));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(below + i), _mm_and_si128(mask, one));
+            }
+
+            classify_row_scalar(row, i, n, isovalue, below);
+        }
+
+        __attribute__((target("sse2"))) inline void row_range_sse2(const uint8_t *row, int n, uint8_t &lo, uint8_t &hi)
+        {
+            if (n < 16)
+                return row_range_scalar(row, 0, n, lo, hi);
+
+            auto vlo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row));
+            auto vhi = vlo;
+            int i = 16;
+            for (; i + 16 <= n; i += 16)
+            {
+                const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i));
+                vlo = _mm_min_epu8(vlo, v);
+                vhi = _mm_max_epu8(vhi, v);
+            }
+
+            range_epu8_sse2(vlo, vhi, lo, hi);
+            row_range_scalar(row, i, n, lo, hi);
+        }
+
+        __attribute__((target("sse2"))) inline void row_range_sse2(const uint16_t *row, int n, uint16_t &lo, uint16_t &hi)
+        {
+            if (n < 8)
+                return row_range_scalar(row, 0, n, lo, hi);
+
+            const auto flip = _mm_set1_epi16(static_cast<short>(0x8000));
+            auto vlo = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(row)), flip);
+            auto vhi = vlo;
+            int i = 8;
+            for (; i + 8 <= n; i += 8)
+            {
+                const auto v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i)), flip);
+                vlo = _mm_min_epi16(vlo, v);
+                vhi = _mm_max_epi16(vhi, v);
+            }
+
+            range_epi16_sse2(vlo, vhi, flip, lo, hi);
+            row_range_scalar(row, i, n, lo, hi);
+        }
+
+        // 4-bit code of the cube face at z = i .. i + 15. Bytes are 0 / 1, so
+        // 16-bit lane shifts never carry bits across byte boundaries.
+        __attribute__((target("sse2"))) inline __m128i combine_square_sse2(const uint8_t *b0, const uint8_t *b1, const uint8_t *b2, const uint8_t *b3, int i)
+        {
+            const auto v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b0 + i));
+            const auto v1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b1 + i));
+            const auto v2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b2 + i));
+            const auto v3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b3 + i));
+            return _mm_or_si128(_mm_or_si128(v0, _mm_slli_epi16(v1, 1)),
+                                _mm_or_si128(_mm_slli_epi16(v2, 2), _mm_slli_epi16(v3, 3)));
+        }
+
+        __attribute__((target("sse2"))) inline void combine_rows_sse2(const uint8_t *b0, const uint8_t *b1, const uint8_t *b2, const uint8_t *b3,
+                                                                      int begin, int end, uint8_t *codes)
+        {
+            int i = begin;
+            for (; i + 16 <= end; i += 16)
+            {
+                const auto s0 = combine_square_sse2(b0, b1, b2, b3, i);
+                const auto s1 = combine_square_sse2(b0, b1, b2, b3, i + 1);
+                const auto code = _mm_or_si128(s0, _mm_slli_epi16(s1, 4));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(codes + i), code);
+            }
+
+            combine_rows_scalar(b0, b1, b2, b3, i, end, codes);
+        }
+
+        __attribute__((target("sse2"))) inline void compact_active_sse2(const uint8_t *codes, int begin, int end, int y, std::vector<Cube> &active)
+        {
+            const auto zero = _mm_setzero_si128();
+            const auto full = _mm_set1_epi8(static_cast<char>(0xff));
+            int i = begin;
+            for (; i + 16 <= end; i += 16)
+            {
+                const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(codes + i));
+                const auto empty = _mm_or_si128(_mm_cmpeq_epi8(v, zero), _mm_cmpeq_epi8(v, full));
+                for (unsigned mask = ~_mm_movemask_epi8(empty) & 0xffff; mask != 0; mask &= mask - 1)
+                {
+                    const auto z = i + __builtin_ctz(mask);
+                    active.emplace_back(Cube{y, z, codes[z]});
+                }
+            }
+
+            compact_active_scalar(codes, i, end, y, active);
+        }
+
+        /*
+         * AVX2 kernels
+         */
+
+        __attribute__((target("avx2"))) inline void classify_row_avx2(const float *row, int n, float isovalue, uint8_t *below)
+        {
+            const auto iso = _mm256_set1_ps(isovalue);
+            int i = 0;
+            for (; i + 8 <= n; i += 8)
+            {
+                const auto mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(row + i), iso, _CMP_LT_OQ));
+                std::memcpy(below + i, &expand_mask8[mask], 8);
+            }
+
+            classify_row_scalar(row, i, n, isovalue, below);
+        }
+
+        __attribute__((target("avx2"))) inline void classify_row_avx2(const double *row, int n, double isovalue, uint8_t *below)
+        {
+            const auto iso = _mm256_set1_pd(isovalue);
+            int i = 0;
+            for (; i + 4 <= n; i += 4)
+            {
+                const auto mask = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(row + i), iso, _CMP_LT_OQ));
+                std::memcpy(below + i, &expand_mask4[mask], 4);
+            }
+
+            classify_row_scalar(row, i, n, isovalue, below);
+        }
+
+        __attribute__((target("avx2"))) inline void row_range_avx2(const float *row, int n, float &lo, float &hi)
+        {
+            if (n < 8)
+                return row_range_sse2(row, n, lo, hi);
+
+            auto vlo = _mm256_loadu_ps(row);
+            auto vhi = vlo;
+            int i = 8;
+            for (; i + 8 <= n; i += 8)
+            {
+                const auto v = _mm256_loadu_ps(row + i);
+                vlo = _mm256_min_ps(vlo, v);
+                vhi = _mm256_max_ps(vhi, v);
+            }
+
+            alignas(32) float l[8], h[8];
+            _mm256_store_ps(l, vlo);
+            _mm256_store_ps(h, vhi);
+            row_range_scalar(l, 0, 8, lo, hi);
+            row_range_scalar(h, 0, 8, lo, hi);
+            row_range_scalar(row, i, n, lo, hi);
+        }
+
+        __attribute__((target("avx2"))) inline void row_range_avx2(const double *row, int n, double &lo, double &hi)
+        {
+            if (n < 4)
+                return row_range_sse2(row, n, lo, hi);
+
+            auto vlo = _mm256_loadu_pd(row);
+            auto vhi = vlo;
+            int i = 4;
+            for (; i + 4 <= n; i += 4)
+            {
+                const auto v = _mm256_loadu_pd(row + i);
+                vlo = _mm256_min_pd(vlo, v);
+                vhi = _mm256_max_pd(vhi, v);
+            }
+
+            alignas(32) double l[4], h[4];
+            _mm256_store_pd(l, vlo);
+            _mm256_store_pd(h, vhi);
+            row_range_scalar(l, 0, 4, lo, hi);
+            row_range_scalar(h, 0, 4, lo, hi);
+            row_range_scalar(row, i, n, lo, hi);
+        }
+
+        __attribute__((target("avx2"))) inline void classify_row_avx2(const uint8_t *row, int n, uint8_t isovalue, uint8_t *below)
+        {
+            const auto iso = _mm256_set1_epi8(static_cast<char>(isovalue));
+            const auto one = _mm256_set1_epi8(0x01);
+            int i = 0;
+            for (; i + 32 <= n; i += 32)
+            {
+                const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + i));
+                const auto notBelow = _mm256_cmpeq_epi8(_mm256_max_epu8(v, iso), v);
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(below + i), _mm256_andnot_si256(notBelow, one));
+            }
+
+            classify_row_sse2(row + i, n - i, isovalue, below + i);
+        }
+
+        __attribute__((target("avx2"))) inline void classify_row_avx2(const uint16_t *row, int n, uint16_t isovalue, uint8_t *below)
+        {
+            const auto iso = _mm256_set1_epi16(static_cast<short>(isovalue));
+            const auto one = _mm256_set1_epi8(0x01);
+            int i = 0;
+            for (; i + 32 <= n; i += 32)
+            {
+                const auto v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + i));
+                const auto v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + i + 16));
+                const auto ge0 = _mm256_cmpeq_epi16(_mm256_max_epu16(v0, iso), v0);
+                const auto ge1 = _mm256_cmpeq_epi16(_mm256_max_epu16(v1, iso), v1);
+                // packs works per 128-bit lane, put the quarters back in order
+                const auto notBelow = _mm256_permute4x64_epi64(_mm256_packs_epi16(ge0, ge1), 0xd8);
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(below + i), _mm256_andnot_si256(notBelow, one));
+            }
+
+            classify_row_sse2(row + i, n - i, isovalue, below + i);
+        }
+
+        __attribute__((target("avx2"))) inline void row_range_avx2(const uint8_t *row, int n, uint8_t &lo, uint8_t &hi)
+        {
+            if (n < 32)
+                return row_range_sse2(row, n, lo, hi);
+
+            auto vlo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row));
+            auto vhi = vlo;
+            int i = 32;
+            for (; i + 32 <= n; i += 32)
+            {
+                const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + i));
+                vlo = _mm256_min_epu8(vlo, v);
+                vhi = _mm256_max_epu8(vhi, v);
+            }
+
+            range_epu8_sse2(_mm_min_epu8(_mm256_castsi256_si128(vlo), _mm256_extracti128_si256(vlo, 1)),
+                            _mm_max_epu8(_mm256_castsi256_si128(vhi), _mm256_extracti128_si256(vhi, 1)), lo, hi);
+            row_range_scalar(row, i, n, lo, hi);
+        }
+
+        __attribute__((target("avx2"))) inline void row_range_avx2(const uint16_t *row, int n, uint16_t &lo, uint16_t &hi)
+        {
+            if (n < 16)
+                return row_range_sse2(row, n, lo, hi);
+
+            auto vlo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row));
+            auto vhi = vlo;
+            int i = 16;
+            for (; i + 16 <= n; i += 16)
+            {
+                const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + i));
+                vlo = _mm256_min_epu16(vlo, v);
+                vhi = _mm256_max_epu16(vhi, v);
+            }
+
+            const auto flip = _mm_set1_epi16(static_cast<short>(0x8000));
+            range_epi16_sse2(_mm_xor_si128(_mm_min_epu16(_mm256_castsi256_si128(vlo), _mm256_extracti128_si256(vlo, 1)), flip),
+                             _mm_xor_si128(_mm_max_epu16(_mm256_castsi256_si128(vhi), _mm256_extracti128_si256(vhi, 1)), flip),
+                             flip, lo, hi);
+            row_range_scalar(row, i, n, lo, hi);
+        }
+
+        __attribute__((target("avx2"))) inline __m256i combine_square_avx2(const uint8_t *b0, const uint8_t *b1, const uint8_t *b2, const uint8_t *b3, int i)
+        {
+            const auto v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b0 + i));
+            const auto v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b1 + i));
+            const auto v2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b2 + i));
+            const auto v3 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b3 + i));
+            return _mm256_or_si256(_mm256_or_si256(v0, _mm256_slli_epi16(v1, 1)),
+                                   _mm256_or_si256(_mm256_slli_epi16(v2, 2), _mm256_slli_epi16(v3, 3)));
+        }
+
+        __attribute__((target("avx2"))) inline void combine_rows_avx2(const uint8_t *b0, const uint8_t *b1, const uint8_t *b2, const uint8_t *b3,
+                                                                      int begin, int end, uint8_t *codes)
+        {
+            int i = begin;
+            for (; i + 32 <= end; i += 32)
+            {
+                const auto s0 = combine_square_avx2(b0, b1, b2, b3, i);
+                const auto s1 = combine_square_avx2(b0, b1, b2, b3, i + 1);
+                const auto code = _mm256_or_si256(s0, _mm256_slli_epi16(s1, 4));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(codes + i), code);
+            }
+
+            combine_rows_scalar(b0, b1, b2, b3, i, end, codes);
+        }
+
+        __attribute__((target("avx2"))) inline void compact_active_avx2(const uint8_t *codes, int begin, int end, int y, std::vector<Cube> &active)
+        {
+            const auto zero = _mm256_setzero_si256();
+            const auto full = _mm256_set1_epi8(static_cast<char>(0xff));
+            int i = begin;
+            for (; i + 32 <= end; i += 32)
+            {
+                const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(codes + i));
+                const auto empty = _mm256_or_si256(_mm256_cmpeq_epi8(v, zero), _mm256_cmpeq_epi8(v, full));
+                for (unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(empty)); mask != 0; mask &= mask - 1)
+                {
+                    const auto z = i + __builtin_ctz(mask);
+                    active.emplace_back(Cube{y, z, codes[z]});
+                }
+            }
+
+            compact_active_scalar(codes, i, end, y, active);
+        }
+#endif
+
+        /*
+         * Dispatch
+         */
+
+        // below[i] = row[i] < isovalue, for i in [0, n)
+        template <typename T>
+        void classify_row(const T *row, int n, T isovalue, uint8_t *below)
+        {
+#ifdef MARCHING_CUBES_X86
+            if constexpr (std::is_same_v<T, float> || std::is_same_v<T, double> ||
+                          std::is_same_v<T, uint8_t> || std::is_same_v<T, uint16_t>)
+            {
+                switch (util::simd_level())
+                {
+                case util::SimdLevel::avx2:
+                    return classify_row_avx2(row, n, isovalue, below);
+                case util::SimdLevel::sse2:
+                    return classify_row_sse2(row, n, isovalue, below);
+                default:
+                    break;
+                }
+            }
+#endif
+            classify_row_scalar(row, 0, n, isovalue, below);
+        }
+
+        // widen [lo, hi] to the values of row[0, n)
+        template <typename T>
+        void row_range(const T *row, int n, T &lo, T &hi)
+        {
+#ifdef MARCHING_CUBES_X86
+            if constexpr (std::is_same_v<T, float> || std::is_same_v<T, double> ||
+                          std::is_same_v<T, uint8_t> || std::is_same_v<T, uint16_t>)
+            {
+                switch (util::simd_level())
+                {
+                case util::SimdLevel::avx2:
+                    return row_range_avx2(row, n, lo, hi);
+                case util::SimdLevel::sse2:
+                    return row_range_sse2(row, n, lo, hi);
+                default:
+                    break;
+                }
+            }
+#endif
+            row_range_scalar(row, 0, n, lo, hi);
+        }
+
+        // Case codes of the cubes [begin, end) of one row, from the classified
+        // grid rows (x, y), (x + 1, y), (x + 1, y + 1) and (x, y + 1), which
+        // are read on [begin, end]. Bit order follows vertex_offsets.
+        inline void combine_rows(const uint8_t *b0, const uint8_t *b1, const uint8_t *b2, const uint8_t *b3,
+                                 int begin, int end, uint8_t *codes)
+        {
+#ifdef MARCHING_CUBES_X86
+            switch (util::simd_level())
+            {
+            case util::SimdLevel::avx2:
+                return combine_rows_avx2(b0, b1, b2, b3, begin, end, codes);
+            case util::SimdLevel::sse2:
+                return combine_rows_sse2(b0, b1, b2, b3, begin, end, codes);
+            default:
+                break;
+            }
+#endif
+            combine_rows_scalar(b0, b1, b2, b3, begin, end, codes);
+        }
+
+        // append every cube of row y in [begin, end) whose code is neither 0 nor 255
+        inline void compact_active(const uint8_t *codes, int begin, int end, int y, std::vector<Cube> &active)
+        {
+#ifdef MARCHING_CUBES_X86
+            switch (util::simd_level())
+            {
+            case util::SimdLevel::avx2:
+                return compact_active_avx2(codes, begin, end, y, active);
+            case util::SimdLevel::sse2:
+                return compact_active_sse2(codes, begin, end, y, active);
+            default:
+                break;
+            }
+#endif
+            compact_active_scalar(codes, begin, end, y, active);
+        }
+    }
+}
@@ -0,0 +1,142 @@
+#pragma once
+#include <algorithm>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "marchingCubes.hpp"
+#include "Voxel.hpp"
+#include "VoxelGrid.hpp"
+#include "Vec.hpp"
+#include "Mesh.hpp"
+
+namespace marching_cubes
+{
+    using mesh::Mesh;
+    using vec::Vec3;
+
+    /**
+     * Out-of-core extraction straight from a TIFF stack. Pages are read into a
+     * ring of smoothSize normalized slices, smoothed one slice at a time and
+     * extracted in chunks of chunkSize cube layers, so peak memory follows
+     * smoothSize + chunkSize slices instead of the stack depth.
+     *
+     * onChunk(const Mesh<T> &chunk) is called once per chunk with the vertices
+     * it adds. Faces use global vertex indices and may refer to vertices of
+     * earlier chunks, so appending the chunks in order gives the mesh of
+     * extract(voxel::smooth(voxel::read_from_tiff<T>(filePath), smoothSize, border), isovalue),
+     * up to rounding of the vertex coordinates. Pages are normalized to [0, 1],
+     * so T must be a floating point type.
+     */
+    template <typename T, typename Func>
+    void extract_from_tiff(const std::string &filePath, T isovalue, int smoothSize, int chunkSize, const Func &onChunk,
+                           voxel::Border border = voxel::Border::clamp)
+    {
+        static_assert(std::is_floating_point_v<T>, "normalized voxels need a floating point type");
+        voxel::TiffReader tiff(filePath);
+        const int X = tiff.pages();
+        const int Y = tiff.height();
+        const int Z = tiff.width();
+        const auto sliceSize = static_cast<std::size_t>(Y) * Z;
+        smoothSize = std::max(smoothSize, 1);
+        chunkSize = std::max(chunkSize, 1);
+
+        // Raw page p lives in slot p % smoothSize until page p + smoothSize is
+        // read. Slice x needs the pages x - r .. x - r + smoothSize - 1 through
+        // the border. They span at most smoothSize pages, so they all stay in
+        // the ring once the largest of them is read. That is not always the
+        // last one: with a mirror border and an even size, slice 0 reaches
+        // page r through -r, one past x - r + smoothSize - 1.
+        const auto gaussian = voxel::_private::generate_gaussian_vector<T>(smoothSize, 0.8);
+        const int r = smoothSize / 2;
+        voxel::VoxelGrid<T> raw(smoothSize, Y, Z);
+        std::vector<const T *> window(smoothSize);
+        std::vector<T> scratch;
+        int nextPage = 0;
+        auto smooth_slice = [&](int x, T *dst)
+        {
+            int lastPage = 0;
+            for (int t = 0; t < smoothSize; t++)
+                lastPage = std::max(lastPage, voxel::_private::border_index(x + t - r, X, border));
+
+            for (; nextPage <= lastPage; nextPage++)
+            {
+                auto *slot = raw.slice(nextPage % smoothSize);
+                tiff.read_page(nextPage, slot);
+                if (tiff.bits_per_sample() == 16)
+                    voxel::_private::normalize<T, T, 0xffff>(slot, sliceSize, slot);
+                else
+                    voxel::_private::normalize<T, T, 0xff>(slot, sliceSize, slot);
+            }
+
+            for (int t = 0; t < smoothSize; t++)
+                window[t] = raw.slice(voxel::_private::border_index(x + t - r, X, border) % smoothSize);
+
+            voxel::_private::smooth_slice(window.data(), Y, Z, gaussian.data(), smoothSize, border, dst, scratch);
+        };
+
+        // Cube layers [c0, c1) need the smoothed slices [c0 - 1, c1 + 1] for
+        // gradients; consecutive chunks share three of them.
+        voxel::VoxelGrid<T> chunk;
+        int first = 0;
+        // global vertex of the y / z edges of plane c0, created by the previous chunk
+        std::vector<int> boundary;
+        int vertexCount = 0;
+        for (int c0 = 0; c0 < X - 1; c0 += chunkSize)
+        {
+            const int c1 = std::min(c0 + chunkSize, X - 1);
+            const int nextFirst = std::max(c0 - 1, 0);
+            const int last = std::min(c1 + 1, X - 1);
+            voxel::VoxelGrid<T> next(last - nextFirst + 1, Y, Z);
+            next.origin[0] = static_cast<float>(nextFirst);
+
+            int x = nextFirst;
+            for (; x < first + chunk.size(0); x++)
+                std::copy(chunk.slice(x - first), chunk.slice(x - first) + sliceSize, next.slice(x - nextFirst));
+
+            for (; x <= last; x++)
+                smooth_slice(x, next.slice(x - nextFirst));
+
+            chunk = std::move(next);
+            first = nextFirst;
+
+            MarchingCubes<T> alg(chunk, isovalue, c0 - first, c1 - first);
+            const auto &mesh = alg.run();
+
+            auto for_each_edge = [&](int plane, const auto &f)
+            {
+                for (int y = 0; y < Y; y++)
+                    for (int z = 0; z < Z; z++)
+                        for (auto dir : {_private::EdgeDir::y, _private::EdgeDir::z})
+                            f((static_cast<std::size_t>(y) * Z + z) * 2 + (dir == _private::EdgeDir::z),
+                              alg.edge_vertex(plane - first, y, z, dir));
+            };
+
+            std::vector<int> index(mesh.vertices.size(), -1);
+            if (c0 > 0)
+                for_each_edge(c0, [&](std::size_t k, int i)
+                              {
+                                  if (i != -1)
+                                      index[i] = boundary[k]; });
+
+            Mesh<T> out;
+            for (std::size_t i = 0; i < mesh.vertices.size(); i++)
+                if (index[i] == -1)
+                {
+                    index[i] = vertexCount++;
+                    out.vertices.emplace_back(mesh.vertices[i]);
+                }
+
+            out.faces.reserve(mesh.faces.size());
+            for (const auto &f : mesh.faces)
+                out.faces.emplace_back(Vec3<int>{index[f[0]], index[f[1]], index[f[2]]});
+
+            boundary.assign(sliceSize * 2, -1);
+            for_each_edge(c1, [&](std::size_t k, int i)
+                          {
+                              if (i != -1)
+                                  boundary[k] = index[i]; });
+
+            onChunk(out);
+        }
+    }
+}
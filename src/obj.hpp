@@ -1,152 +1,423 @@
 #pragma once
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
 #include <string>
-#include <iostream>
-#include <fstream>
+#include <type_traits>
 #include <vector>
-#include <map>
 #include "marchingCubes.hpp"
+#include "BufferedWriter.hpp"
+#include "MappedFile.hpp"
+#include "util.hpp"
 #include "Mesh.hpp"
 #include "Vec.hpp"
 
 namespace obj
 {
-    mesh::Mesh<float> read(const std::string &filePath)
+    namespace _private
     {
-        std::ifstream stream;
-        stream.open(filePath, std::ios::in);
+        inline const char *skip_blanks(const char *p, const char *end)
+        {
+            while (p < end && (*p == ' ' || *p == '\t'))
+                p++;
+
+            return p;
+        }
+
+        inline const char *next_line(const char *p, const char *end)
+        {
+            const auto *eol = static_cast<const char *>(std::memchr(p, '\n', end - p));
+            return eol == nullptr ? end : eol + 1;
+        }
+
+        // parse a number after optional blanks, false if there is none
+        template <typename U>
+        bool parse_number(const char *&p, const char *end, U &value)
+        {
+            p = skip_blanks(p, end);
+            if constexpr (std::is_floating_point_v<U>)
+                if (p < end && *p == '+')
+                    p++;
+
+            const auto [ptr, ec] = std::from_chars(p, end, value);
+            if (ec != std::errc())
+                return false;
+
+            p = ptr;
+            return true;
+        }
 
-        std::string s;
-        std::vector<vec::Vec3<float>> vertices;
-        std::vector<vec::Vec3<float>> normals;
-        std::vector<vec::Vec3<vec::Vec3<int>>> faces;
-        while (getline(stream, s))
+        // one face corner v, v/t, v//n or v/t/n, missing indices are 0; false at a comment
+        inline bool parse_corner(const char *&p, const char *end, vec::Vec3<int> &corner)
         {
-            if (s.starts_with('v'))
+            corner = vec::Vec3<int>{0, 0, 0};
+            p = skip_blanks(p, end);
+            if (p < end && *p == '#')
+                return false;
+
+            if (!parse_number(p, end, corner[0]))
+                return false;
+
+            for (int k = 1; k < 3 && p < end && *p == '/'; k++)
             {
-                vec::Vec3<float> v;
-                int i = 2;
-                for (int k = 0; k < 3; k++)
-                {
-                    while (i < s.size() && !(s[i] == '-' || s[i] == '.' || (s[i] >= '0' && s[i] <= '9')))
-                        i++;
+                p++;
+                if (p < end && *p != '/')
+                    p = std::from_chars(p, end, corner[k]).ptr;
 
-                    int j = i;
-                    while (i < s.size() && (s[i] == '-' || s[i] == '.' || (s[i] >= '0' && s[i] <= '9')))
-                        i++;
-                    v[k] = std::stof(s.substr(j, i - j));
+                // texture and normal indices may be left out
+                while (p < end && *p != '/' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' && *p != '#')
+                    p++;
+            }
+
+            return true;
+        }
+
+        /**
+         * Open addressing map from 64-bit keys to vertex indices, for the
+         * (position, normal) pairs met in faces. Capacity stays a power of
+         * two at most half full.
+         */
+        class VertexIndexMap
+        {
+        public:
+            VertexIndexMap(std::size_t expected)
+            {
+                std::size_t capacity = 16;
+                while (capacity < 2 * expected)
+                    capacity *= 2;
+
+                slots.assign(capacity, Slot{EMPTY, 0});
+            }
+
+            // index stored for key, or value after storing it if the key is new
+            int find_or_insert(uint64_t key, int value)
+            {
+                if (2 * (count + 1) > slots.size())
+                    grow();
+
+                auto &slot = probe(key);
+                if (slot.key == EMPTY)
+                {
+                    slot = Slot{key, value};
+                    count++;
                 }
 
-                if (s.starts_with("vn"))
-                    normals.emplace_back(v);
-                else
-                    vertices.emplace_back(v);
+                return slot.index;
             }
 
-            if (s.starts_with('f'))
+        private:
+            static constexpr uint64_t EMPTY = ~uint64_t(0);
+            struct Slot
             {
-                vec::Vec4<vec::Vec3<int>> f;
-                int i = 2;
-                for (int k = 0; k < 4; k++)
+                uint64_t key;
+                int index;
+            };
+
+            std::vector<Slot> slots;
+            std::size_t count = 0;
+
+            Slot &probe(uint64_t key)
+            {
+                // Fibonacci hashing: the top log2(capacity) bits of the
+                // product depend on every bit of the key
+                const auto mask = slots.size() - 1;
+                auto i = static_cast<std::size_t>((key * 0x9e3779b97f4a7c15ull) >> (64 - std::countr_zero(slots.size())));
+                while (slots[i].key != EMPTY && slots[i].key != key)
+                    i = (i + 1) & mask;
+
+                return slots[i];
+            }
+
+            void grow()
+            {
+                auto old = std::move(slots);
+                slots.assign(old.size() * 2, Slot{EMPTY, 0});
+                for (const auto &slot : old)
+                    if (slot.key != EMPTY)
+                        probe(slot.key) = slot;
+            }
+        };
+    }
+
+    namespace _private
+    {
+        constexpr std::size_t READ_CHUNK_BYTES = 1 << 20; // lines parsed by one task
+
+        // the records of one run of whole lines
+        struct Chunk
+        {
+            const char *begin;
+            const char *end;
+            std::size_t vertexN = 0;
+            std::size_t normalN = 0;
+            // triangles of the faces once split into fans
+            std::size_t triangleN = 0;
+        };
+
+        inline bool is_blank(char c) { return c == ' ' || c == '\t'; }
+        inline bool is_vertex(const char *p, const char *end) { return end - p > 1 && p[0] == 'v' && is_blank(p[1]); }
+        inline bool is_normal(const char *p, const char *end) { return end - p > 2 && p[0] == 'v' && p[1] == 'n' && is_blank(p[2]); }
+        inline bool is_face(const char *p, const char *end) { return end - p > 1 && p[0] == 'f' && is_blank(p[1]); }
+
+        // number of blank separated corners of the face record at p, up to a comment
+        inline int count_corners(const char *p, const char *end)
+        {
+            int n = 0;
+            for (p++; p < end && *p != '\n' && *p != '\r' && *p != '#';)
+            {
+                if (is_blank(*p))
                 {
-                    while (i < s.size() && !(s[i] >= '0' && s[i] <= '9'))
-                        i++;
+                    p++;
+                    continue;
+                }
 
-                    int j = i;
-                    while (i < s.size() && (s[i] >= '0' && s[i] <= '9'))
-                        i++;
-                    f[k][0] = std::stoi(s.substr(j, i - j));
-                    i++;
+                n++;
+                while (p < end && !is_blank(*p) && *p != '\n' && *p != '\r' && *p != '#')
+                    p++;
+            }
 
-                    if (s[i] != '/')
-                    {
-                        j = i;
-                        while (i < s.size() && (s[i] >= '0' && s[i] <= '9'))
-                            i++;
-                        f[k][1] = std::stoi(s.substr(j, i - j));
-                    }
-                    else
-                    {
-                        f[k][1] = 0;
-                        i++;
-                    }
+            return n;
+        }
 
-                    if (s[i] != ' ')
-                    {
-                        j = i;
-                        while (i < s.size() && (s[i] >= '0' && s[i] <= '9'))
-                            i++;
-                        f[k][2] = std::stoi(s.substr(j, i - j));
-                    }
-                    else
+        // cut [begin, end) into about n chunks ending at line ends
+        inline std::vector<Chunk> split_lines(const char *begin, const char *end, int n)
+        {
+            std::vector<Chunk> chunks;
+            const auto step = (end - begin) / n + 1;
+            for (const char *p = begin; p < end;)
+            {
+                const char *q = end - p > step ? next_line(p + step - 1, end) : end;
+                chunks.emplace_back(Chunk{begin : p, end : q});
+                p = q;
+            }
+
+            return chunks;
+        }
+
+        inline void count_records(Chunk &chunk)
+        {
+            for (const char *p = chunk.begin; p < chunk.end; p = next_line(p, chunk.end))
+                if (is_vertex(p, chunk.end))
+                    chunk.vertexN++;
+                else if (is_normal(p, chunk.end))
+                    chunk.normalN++;
+                else if (is_face(p, chunk.end))
+                    chunk.triangleN += std::max(count_corners(p, chunk.end) - 2, 0);
+        }
+
+        /**
+         * Parse the records of a chunk. Its positions, normals and triangles
+         * go to vertices / normals / triangles from the given offsets, the
+         * counts of all chunks before it, which also resolve relative
+         * (negative) indices. A polygon of n corners becomes the fan of
+         * triangles (0, i, i + 1), which keeps its winding. Triangle corners
+         * are (v, t, n), 0-based, -1 where missing; t is always missing.
+         */
+        inline void parse_records(const Chunk &chunk, vec::Vec3<float> *vertices, std::size_t vertexOffset,
+                                  vec::Vec3<float> *normals, std::size_t normalOffset,
+                                  vec::Vec3<vec::Vec3<int>> *triangles, std::size_t triangleOffset,
+                                  const char *fileBegin, const std::string &filePath)
+        {
+            const char *end = chunk.end;
+            auto fail = [&](const char *p)
+            {
+                const auto line = std::count(fileBegin, p, '\n') + 1;
+                throw std::runtime_error("invalid obj record at line " + std::to_string(line) + ": " + filePath);
+            };
+
+            auto vertexN = vertexOffset;
+            auto normalN = normalOffset;
+            auto *triangle = triangles + triangleOffset;
+            // corners of the current face, reused by every face
+            std::vector<vec::Vec3<int>> corners;
+            for (const char *p = chunk.begin; p < end; p = next_line(p, end))
+            {
+                if (is_vertex(p, end) || is_normal(p, end))
+                {
+                    auto &v = p[1] == 'n' ? normals[normalN++] : vertices[vertexN++];
+                    const char *q = p + (p[1] == 'n' ? 2 : 1);
+                    for (int k = 0; k < 3; k++)
+                        if (!parse_number(q, end, v[k]))
+                            fail(p);
+                }
+                else if (is_face(p, end))
+                {
+                    const char *q = p + 1;
+                    vec::Vec3<int> corner;
+                    corners.clear();
+                    while (parse_corner(q, end, corner))
                     {
-                        f[k][2] = 0;
-                        i++;
+                        // 1-based, or counted back from the last record; texture coordinates are not kept
+                        corner[0] = corner[0] < 0 ? static_cast<int>(vertexN) + corner[0] : corner[0] - 1;
+                        corner[1] = -1;
+                        corner[2] = corner[2] < 0 ? static_cast<int>(normalN) + corner[2] : corner[2] - 1;
+
+                        corners.emplace_back(corner);
                     }
-                }
 
-                vec::Vec3<vec::Vec3<int>> f1{f[0], f[1], f[2]};
-                vec::Vec3<vec::Vec3<int>> f2{f[1], f[2], f[3]};
-                faces.emplace_back(f1);
-                faces.emplace_back(f2);
+                    // the corners must be all there is, as count_records saw them
+                    if (corners.size() < 3 || static_cast<int>(corners.size()) != count_corners(p, end))
+                        fail(p);
+
+                    for (std::size_t i = 1; i + 1 < corners.size(); i++)
+                        *triangle++ = vec::Vec3<vec::Vec3<int>>{corners[0], corners[i], corners[i + 1]};
+                }
             }
         }
-        stream.close();
+    }
+
+    /**
+     * Read an OBJ mesh. The file is memory mapped and numbers are parsed in
+     * place with std::from_chars. Chunks of whole lines are parsed on up to
+     * `threads` threads: a first pass counts their records, so every record
+     * has its place in the shared buffers before the second one parses them.
+     * Faces of any number of corners, in the forms v, v/t, v//n and v/t/n,
+     * are split into fans of triangles.
+     * Vertices are the distinct (position, normal) pairs referenced by faces,
+     * in order of first reference, whatever the thread count.
+     */
+    inline mesh::Mesh<float> read(const std::string &filePath, int threads = 1)
+    {
+        util::MappedFile file(filePath);
+        const char *begin = file.data();
+        const char *end = begin + file.size();
+        const auto chunkN = std::max<std::size_t>(1, std::min<std::size_t>(threads * 4, file.size() / _private::READ_CHUNK_BYTES));
+        auto chunks = _private::split_lines(begin, end, chunkN);
+        const int n = chunks.size();
+
+        util::parallel_for(n, threads, [&](int c)
+                           { _private::count_records(chunks[c]); });
+
+        std::vector<std::size_t> vertexOffset(n + 1, 0), normalOffset(n + 1, 0), faceOffset(n + 1, 0);
+        for (int c = 0; c < n; c++)
+        {
+            vertexOffset[c + 1] = vertexOffset[c] + chunks[c].vertexN;
+            normalOffset[c + 1] = normalOffset[c] + chunks[c].normalN;
+            faceOffset[c + 1] = faceOffset[c] + chunks[c].triangleN;
+        }
+
+        std::vector<vec::Vec3<float>> vertices(vertexOffset[n]);
+        std::vector<vec::Vec3<float>> normals(normalOffset[n]);
+        std::vector<vec::Vec3<vec::Vec3<int>>> faces(faceOffset[n]);
+        util::parallel_for(n, threads, [&](int c)
+                           { _private::parse_records(chunks[c], vertices.data(), vertexOffset[c], normals.data(), normalOffset[c],
+                                                     faces.data(), faceOffset[c], begin, filePath); });
 
         mesh::Mesh<float> mesh;
-        std::map<long, int> vertexMap;
-        for (auto f : faces)
+        mesh.faces.reserve(faces.size());
+        mesh.vertices.reserve(vertices.size());
+        _private::VertexIndexMap vertexMap(vertices.size());
+        for (const auto &f : faces)
         {
             vec::Vec3<int> face;
             for (int i = 0; i < 3; i++)
             {
-                auto v = f[i][0] - 1;
-                auto n = f[i][2] - 1;
-                long id = v << 32 + n;
-                if (!vertexMap.count(id))
+                const auto v = f[i][0];
+                const auto n = f[i][2];
+                if (v < 0 || v >= static_cast<int>(vertices.size()) || n < -1 || n >= static_cast<int>(normals.size()))
+                    throw std::runtime_error("obj face refers to a missing vertex: " + filePath);
+
+                // position and normal in one key, n + 1 keeps "no normal" at 0
+                const auto id = (static_cast<uint64_t>(v) << 32) | static_cast<uint32_t>(n + 1);
+                face[i] = vertexMap.find_or_insert(id, mesh.vertices.size());
+                if (face[i] == static_cast<int>(mesh.vertices.size()))
                 {
-                    vertexMap[id] = mesh.vertices.size();
                     mesh::Vertex<float> vertex{coord : vertices[v]};
                     if (n != -1)
                         vertex.normal = normals[n];
+
                     mesh.vertices.emplace_back(vertex);
                 }
-                face[i] = vertexMap[id];
             }
+
             mesh.faces.emplace_back(face);
         }
+
         return mesh;
     }
 
+    namespace _private
+    {
+        template <typename T>
+        char *put_number(char *p, T value, int precision)
+        {
+            // the caller reserves room for the longest number
+            const auto end = p + 64;
+            return (precision < 0 ? std::to_chars(p, end, value)
+                                  : std::to_chars(p, end, value, std::chars_format::general, precision))
+                .ptr;
+        }
+
+        template <typename T>
+        void put_vec(util::BufferedWriter &writer, const char *tag, const vec::Vec3<T> &v, int precision)
+        {
+            auto *p = writer.reserve_bytes(256);
+            for (; *tag != '\0'; tag++)
+                *p++ = *tag;
+
+            for (int k = 0; k < 3; k++)
+            {
+                *p++ = ' ';
+                p = put_number(p, v[k], precision);
+            }
+
+            *p++ = '\n';
+            writer.commit(p);
+        }
+    }
+
+    /**
+     * Save as OBJ. Numbers are formatted into a large buffer which is written
+     * once per chunk. Coordinates keep `precision` significant digits, or the
+     * shortest form that reads back exactly if it is negative. Normals, and
+     * the normal index of every face corner, are only written if the mesh has
+     * normals.
+     */
     template <typename T>
-    void save(const std::string &filePath, const mesh::Mesh<T> &mesh)
+    void save(const std::string &filePath, const mesh::Mesh<T> &mesh, int precision = -1)
     {
-        std::ofstream stream;
-        stream.open(filePath, std::ios::out);
+        precision = std::min(precision, 64 - 10); // sign, point and exponent fit in the rest
+        const bool normals = mesh::has_normals(mesh);
+        util::BufferedWriter writer(filePath);
+        auto put_text = [&writer](const std::string &text)
+        { writer.put_bytes(text.data(), text.size()); };
 
-        stream << "# List of vertices" << std::endl;
+        put_text("# List of vertices\n");
         for (auto &v : mesh.vertices)
-            stream << "v "
-                   << std::setprecision(4) << std::setw(7) << v.coord[0] << " "
-                   << std::setprecision(4) << std::setw(7) << v.coord[1] << " "
-                   << std::setprecision(4) << std::setw(7) << v.coord[2] << std::endl;
-        stream << std::endl;
+            _private::put_vec(writer, "v", v.coord, precision);
 
-        stream << "# List of normals" << std::endl;
-        for (auto &v : mesh.vertices)
-            stream << "vn "
-                   << std::setprecision(4) << std::setw(7) << v.normal[0] << " "
-                   << std::setprecision(4) << std::setw(7) << v.normal[1] << " "
-                   << std::setprecision(4) << std::setw(7) << v.normal[2] << std::endl;
-        stream << std::endl;
+        if (normals)
+        {
+            put_text("\n# List of normals\n");
+            for (auto &v : mesh.vertices)
+                _private::put_vec(writer, "vn", v.normal, precision);
+        }
 
-        stream << "# List of faces" << std::endl;
+        put_text("\n# List of faces\n");
         for (auto &f : mesh.faces)
-            stream << "f"
-                   << " " << f[0] + 1 << "//" << f[0] + 1
-                   << " " << f[1] + 1 << "//" << f[1] + 1
-                   << " " << f[2] + 1 << "//" << f[2] + 1
-                   << std::endl;
+        {
+            auto *p = writer.reserve_bytes(128);
+            *p++ = 'f';
+            for (int k = 0; k < 3; k++)
+            {
+                // vertex i has normal i
+                *p++ = ' ';
+                p = std::to_chars(p, p + 16, f[k] + 1).ptr;
+                if (normals)
+                {
+                    *p++ = '/';
+                    *p++ = '/';
+                    p = std::to_chars(p, p + 16, f[k] + 1).ptr;
+                }
+            }
+
+            *p++ = '\n';
+            writer.commit(p);
+        }
 
-        stream.close();
+        writer.close();
     }
 }
@@ -1,200 +1,474 @@
 #pragma once
+#include <algorithm>
+#include <array>
 #include <cmath>
-#include <queue>
 #include <tuple>
 #include <vector>
-#include <set>
 #include <limits>
+#include "IndexedHeap.hpp"
 #include "Matrix.hpp"
 #include "Mesh.hpp"
+#include "MeshAdjacency.hpp"
+#include "util.hpp"
 #include "Vec.hpp"
 
 namespace quadric_error_metrics
 {
     using matrix::SymmetryMatrix4;
     using mesh::Mesh;
-    constexpr int INVALID = std::numeric_limits<int>::min();
+    using vec::Vec3;
 
+    namespace _private
+    {
+        // func(begin, end) over [0, n) in a few blocks per thread
+        template <typename Func>
+        void parallel_blocks(int n, int threads, const Func &func)
+        {
+            const int blockN = std::max(1, std::min(n, threads * 4));
+            util::parallel_for(blockN, threads, [&](int b)
+                               { func(static_cast<long long>(n) * b / blockN, static_cast<long long>(n) * (b + 1) / blockN); });
+        }
+
+        template <typename R, typename T>
+        Vec3<R> convert(const Vec3<T> &v)
+        {
+            return Vec3<R>{static_cast<R>(v[0]), static_cast<R>(v[1]), static_cast<R>(v[2])};
+        }
+
+        // error of the quadric q at point p
+        template <typename T>
+        T quadric_error(const SymmetryMatrix4<T> &q, const Vec3<T> &p)
+        {
+            vec::Vec4<T> v(p, 1);
+            return std::abs(v * q * v);
+        }
+
+        /**
+         * Point where the error of q is least, where its gradient is zero:
+         * A p = -b, with A the upper 3x3 block of q and b the rest of its last
+         * column. Solved by Cramer's rule; false when A is close to singular,
+         * as for planes that are all parallel or meet in one line, and the
+         * least error is reached along a line or plane rather than a point.
+         */
+        template <typename T>
+        bool optimal_position(const SymmetryMatrix4<T> &q, Vec3<T> &p)
+        {
+            // cofactors of A, which is symmetric
+            const T c00 = q(1, 1) * q(2, 2) - q(1, 2) * q(1, 2);
+            const T c01 = q(0, 2) * q(1, 2) - q(0, 1) * q(2, 2);
+            const T c02 = q(0, 1) * q(1, 2) - q(0, 2) * q(1, 1);
+            const T c11 = q(0, 0) * q(2, 2) - q(0, 2) * q(0, 2);
+            const T c12 = q(0, 1) * q(0, 2) - q(0, 0) * q(1, 2);
+            const T c22 = q(0, 0) * q(1, 1) - q(0, 1) * q(0, 1);
+            const T det = q(0, 0) * c00 + q(0, 1) * c01 + q(0, 2) * c02;
+
+            // A is a sum of n n^T over unit plane normals, compare to its scale
+            const T trace = q(0, 0) + q(1, 1) + q(2, 2);
+            if (!(det > static_cast<T>(1e-5) * trace * trace * trace))
+                return false;
+
+            const T b0 = q(0, 3);
+            const T b1 = q(1, 3);
+            const T b2 = q(2, 3);
+            p = Vec3<T>{-(c00 * b0 + c01 * b1 + c02 * b2) / det,
+                        -(c01 * b0 + c11 * b1 + c12 * b2) / det,
+                        -(c02 * b0 + c12 * b1 + c22 * b2) / det};
+            return true;
+        }
+    }
+
+    // how vertex quadrics follow contractions
+    enum class Quadrics
+    {
+        recompute,  // from the current planes of the faces around the vertex
+        accumulate, // Q(v1) += Q(v2), the planes of the original faces
+    };
+
+    // edge that may be contracted, its quadric error is its key in the heap
     template <typename T>
     struct Pair
     {
         int v1;
         int v2;
-        int version; // invalid when any vertex change
-        T quadricError;
-        mesh::Vertex<T> newVertex;
-        bool operator<(const Pair<T> &p) const { return quadricError >= p.quadricError; }
+        // new vertex: coord, with val and normal interpolated at t along v1 -> v2
+        Vec3<T> coord;
+        T t;
     };
 
-    template <typename T>
+    // T is the type of the mesh, R the one quadrics are kept and compared in
+    template <typename T, typename R = T>
     class QuadricErrorMetrics
     {
     public:
-        QuadricErrorMetrics(Mesh<T> &mesh);
-        void simplify(int N);
+        QuadricErrorMetrics(Mesh<T> &mesh, int threads = 1, Quadrics quadrics = Quadrics::recompute);
+        void simplify(int N, double batchPercent = 0);
 
     private:
         Mesh<T> &mesh;
-        std::vector<std::set<int>> vertexFaces;
-        std::vector<int> vertexVersions;
-        std::priority_queue<Pair<T>> pairs;
-        std::vector<SymmetryMatrix4<T>> faceKp;
-        std::vector<SymmetryMatrix4<T>> vertexKp;
-        std::vector<bool> validFaces;
+        int threads;
+        Quadrics quadrics;
+        mesh::VertexLists vertexFaces;
+        // char rather than bool, so merges in a batch can set them concurrently
+        std::vector<char> validVertices;
+        // every edge gets one pair id, the heap only holds the live ones
+        std::vector<Pair<T>> pairs;
+        mesh::VertexLists vertexPairs;
+        util::IndexedHeap<R> heap;
+        // face Kp is only kept to recompute
+        std::vector<SymmetryMatrix4<R>> faceKp;
+        std::vector<SymmetryMatrix4<R>> vertexKp;
+        std::vector<char> validFaces;
+        // vertex v is taken by the batch of round r when claims[v] == r
+        std::vector<int> claims;
+        int round = 0;
+        // pairs the last serial merge found duplicated
+        std::vector<int> duplicates;
 
         void build_pairs();
-        int contract_pair(const Pair<T> &pair);
+        int contract_pair(int pairID);
+        int contract_batch(int simplifyN, int batchN);
+        bool claim(int pairID);
+        int shared_faces(int pairID);
+        int merge_pair(int pairID, std::vector<int> &duplicates);
         void tidy_mesh();
 
         void update_face_kp(int faceID);
         void update_vertex_kp(int verticeID);
-        void emplace_pair(int v1, int v2);
+        void update_kp(int pairID);
+        R price_pair(int pairID);
+        void update_pair(int pairID) { heap.update(pairID, price_pair(pairID)); };
     };
 
-    template <typename T>
-    void simplify(Mesh<T> &mesh, double simplifyPercent)
+    /**
+     * Contract edges by quadric error until about simplifyPercent * vertices
+     * faces are gone. With batchPercent > 0 every round takes the cheapest
+     * batchPercent of the remaining edges, keeps those whose neighbourhoods
+     * do not overlap and contracts them together on up to `threads` threads,
+     * the quadrics and pairs they change included. Larger batches run faster
+     * and drift further from strict cheapest-first order; 0 contracts one
+     * edge at a time.
+     *
+     * Quadrics are recomputed from the faces around a vertex after every
+     * contraction, or accumulated, which costs one addition per contraction.
+     * R = double keeps accumulated quadrics of a float mesh precise.
+     */
+    template <typename T, typename R = T>
+    void simplify(Mesh<T> &mesh, double simplifyPercent, int threads = 1, double batchPercent = 0,
+                  Quadrics quadrics = Quadrics::recompute)
     {
         const auto simplifyN = std::ceil(mesh.vertices.size() * simplifyPercent);
-        QuadricErrorMetrics<T> qem(mesh);
-        qem.simplify(simplifyN);
+        QuadricErrorMetrics<T, R> qem(mesh, threads, quadrics);
+        qem.simplify(simplifyN, batchPercent);
     };
 
-    template <typename T>
-    QuadricErrorMetrics<T>::QuadricErrorMetrics(Mesh<T> &mesh)
+    template <typename T, typename R>
+    QuadricErrorMetrics<T, R>::QuadricErrorMetrics(Mesh<T> &mesh, int threads, Quadrics quadrics)
         : mesh(mesh),
-          vertexFaces(mesh.vertices.size()),
-          vertexVersions(mesh.vertices.size(), 1),
+          threads(threads),
+          quadrics(quadrics),
+          vertexFaces(mesh::vertex_faces(mesh.vertices.size(), mesh.faces)),
+          validVertices(mesh.vertices.size(), true),
           faceKp(mesh.faces.size()),
           vertexKp(mesh.vertices.size()),
           validFaces(mesh.faces.size(), true)
     {
-        // build vertex faces
-        for (auto i = 0; i < mesh.faces.size(); i++)
-            for (int j = 0; j < mesh.faces[i].size(); j++)
-                vertexFaces[mesh.faces[i][j]].emplace(i);
-
         // build face Kp
-        for (int i = 0; i < mesh.faces.size(); i++)
-            update_face_kp(i);
+        _private::parallel_blocks(mesh.faces.size(), threads, [&](int begin, int end)
+                                  {
+                                      for (int i = begin; i < end; i++)
+                                          update_face_kp(i); });
 
         // build vertex Kp
-        for (int i = 0; i < mesh.vertices.size(); i++)
-            update_vertex_kp(i);
+        _private::parallel_blocks(mesh.vertices.size(), threads, [&](int begin, int end)
+                                  {
+                                      for (int i = begin; i < end; i++)
+                                          update_vertex_kp(i); });
+
+        if (quadrics == Quadrics::accumulate)
+            faceKp = {};
 
         // build vertex pairs
         build_pairs();
     }
 
-    template <typename T>
-    void QuadricErrorMetrics<T>::simplify(int simplifyN)
+    template <typename T, typename R>
+    void QuadricErrorMetrics<T, R>::simplify(int simplifyN, double batchPercent)
     {
-        while (simplifyN > 0 && !pairs.empty())
+        if (batchPercent > 0)
         {
-            auto p = pairs.top();
-            pairs.pop();
-            if (vertexVersions[p.v1] + vertexVersions[p.v2] == p.version)
-                simplifyN -= contract_pair(p);
+            claims.assign(mesh.vertices.size(), 0);
+            while (simplifyN > 0 && !heap.empty())
+            {
+                const int batchN = std::max(1.0, std::ceil(heap.size() * batchPercent));
+                simplifyN -= contract_batch(simplifyN, batchN);
+            }
         }
 
+        while (simplifyN > 0 && !heap.empty())
+            simplifyN -= contract_pair(heap.pop());
+
         tidy_mesh();
     };
 
-    template <typename T>
-    void QuadricErrorMetrics<T>::build_pairs()
+    template <typename T, typename R>
+    void QuadricErrorMetrics<T, R>::build_pairs()
     {
-        std::set<long> pairIds;
-        for (auto i = 0; i < mesh.faces.size(); i++)
-        {
-            const auto &face = mesh.faces[i];
-            if (mesh::hasDegenerate(face))
-            {
+        for (std::size_t i = 0; i < mesh.faces.size(); i++)
+            if (mesh::hasDegenerate(mesh.faces[i]))
                 validFaces[i] = false;
-                continue;
-            }
 
-            std::array<int, 6> edges{face[0], face[1],
-                                     face[1], face[2],
-                                     face[2], face[0]};
-            for (auto j = 0; j < edges.size(); j += 2)
+        const auto edges = mesh::edges(mesh.faces, vertexFaces);
+        vertexPairs = mesh::vertex_edges(mesh.vertices.size(), edges);
+        pairs.reserve(edges.size());
+        for (const auto &edge : edges)
+            pairs.emplace_back(Pair<T>{v1 : edge[0], v2 : edge[1], coord : {}, t : 0});
+
+        std::vector<R> errors(pairs.size());
+        _private::parallel_blocks(pairs.size(), threads, [&](int begin, int end)
+                                  {
+                                      for (int i = begin; i < end; i++)
+                                          errors[i] = price_pair(i); });
+
+        for (std::size_t i = 0; i < pairs.size(); i++)
+            heap.push(i, errors[i]);
+    }
+
+    template <typename T, typename R>
+    int QuadricErrorMetrics<T, R>::contract_pair(int pairID)
+    {
+        duplicates.clear();
+        const int degenerateFace = merge_pair(pairID, duplicates);
+        for (auto id : duplicates)
+            heap.remove(id);
+
+        update_kp(pairID);
+
+        // only the pairs of v1 see the new Kp
+        for (auto id : vertexPairs[pairs[pairID].v1])
+            update_pair(id);
+
+        return degenerateFace;
+    }
+
+    template <typename T, typename R>
+    int QuadricErrorMetrics<T, R>::contract_batch(int simplifyN, int batchN)
+    {
+        // cheapest pairs, those whose neighbourhood is taken go back
+        round++;
+        std::vector<std::pair<int, R>> batch;
+        std::vector<std::pair<int, R>> skipped;
+        for (int k = 0; k < batchN && !heap.empty(); k++)
+        {
+            const R error = heap.top_key();
+            const int id = heap.pop();
+            if (claim(id))
+                batch.emplace_back(id, error);
+            else
+                skipped.emplace_back(id, error);
+        }
+
+        // back before merging, which may remove them as duplicates
+        for (const auto &[id, error] : skipped)
+            heap.push(id, error);
+
+        // stop once enough faces are gone, counted before merging
+        const int batchSize = batch.size();
+        int degenerateFace = 0;
+        int n = 0;
+        for (; n < batchSize && degenerateFace < simplifyN; n++)
+            degenerateFace += shared_faces(batch[n].first);
+
+        for (int k = n; k < batchSize; k++)
+            heap.push(batch[k].first, batch[k].second);
+
+        // Neighbourhoods are disjoint, so every face, vertex, Kp and pair a
+        // contraction touches is its own and they run in parallel. Only the
+        // lists of v1 could move when they grow, so they get their room first,
+        // and duplicated pairs leave the heap afterwards.
+        for (int k = 0; k < n; k++)
+        {
+            const auto &pair = pairs[batch[k].first];
+            vertexPairs.reserve(pair.v1, vertexPairs[pair.v1].size() + vertexPairs[pair.v2].size());
+            vertexFaces.reserve(pair.v1, vertexFaces[pair.v1].size() + vertexFaces[pair.v2].size());
+        }
+
+        std::vector<std::vector<int>> removed(n);
+        _private::parallel_blocks(n, threads, [&](int begin, int end)
+                                  {
+                                      for (int k = begin; k < end; k++)
+                                      {
+                                          merge_pair(batch[k].first, removed[k]);
+                                          update_kp(batch[k].first);
+                                      } });
+
+        for (const auto &ids : removed)
+            for (auto id : ids)
+                heap.remove(id);
+
+        std::vector<int> updated;
+        for (int k = 0; k < n; k++)
+            for (auto id : vertexPairs[pairs[batch[k].first].v1])
+                updated.emplace_back(id);
+
+        std::vector<R> errors(updated.size());
+        _private::parallel_blocks(updated.size(), threads, [&](int begin, int end)
+                                  {
+                                      for (int k = begin; k < end; k++)
+                                          errors[k] = price_pair(updated[k]); });
+
+        for (std::size_t k = 0; k < updated.size(); k++)
+            heap.update(updated[k], errors[k]);
+
+        return degenerateFace;
+    }
+
+    template <typename T, typename R>
+    bool QuadricErrorMetrics<T, R>::claim(int pairID)
+    {
+        // the pair and every vertex next to it
+        const std::array<int, 2> ends{pairs[pairID].v1, pairs[pairID].v2};
+        auto for_each_vertex = [&](const auto &f)
+        {
+            for (auto v : ends)
             {
-                auto v1 = edges[j + 0];
-                auto v2 = edges[j + 1];
-                long id = v2 > v1 ? ((v1 << 32) + v2)
-                                  : ((v2 << 32) + v1);
-                if (pairIds.contains(id))
-                    continue;
-
-                pairIds.insert(id);
-                emplace_pair(v1, v2);
+                f(v);
+                for (auto id : vertexPairs[v])
+                    f(pairs[id].v1 == v ? pairs[id].v2 : pairs[id].v1);
             }
+        };
+
+        bool free = true;
+        for_each_vertex([&](int v)
+                        { free = free && claims[v] != round; });
+        if (free)
+            for_each_vertex([&](int v)
+                            { claims[v] = round; });
+
+        return free;
+    }
+
+    template <typename T, typename R>
+    int QuadricErrorMetrics<T, R>::shared_faces(int pairID)
+    {
+        // the faces around both ends, merge_pair makes them degenerate
+        const auto v1 = pairs[pairID].v1;
+        int n = 0;
+        for (auto faceID : vertexFaces[pairs[pairID].v2])
+        {
+            const auto &face = mesh.faces[faceID];
+            if (validFaces[faceID] && (face[0] == v1 || face[1] == v1 || face[2] == v1))
+                n++;
         }
+
+        return n;
     }
 
-    template <typename T>
-    int QuadricErrorMetrics<T>::contract_pair(const Pair<T> &pair)
+    template <typename T, typename R>
+    int QuadricErrorMetrics<T, R>::merge_pair(int pairID, std::vector<int> &duplicates)
     {
-        mesh.vertices[pair.v1] = pair.newVertex;
-        vertexVersions[pair.v1]++;
-        vertexVersions[pair.v2] = INVALID;
+        const auto &pair = pairs[pairID];
+        const auto v1 = pair.v1;
+        const auto v2 = pair.v2;
+        const auto &a = mesh.vertices[v1];
+        const auto &b = mesh.vertices[v2];
+        auto newVertex = pair.t == 0 ? a : pair.t == 1 ? b : mesh::interpolate(pair.t, a, b);
+        newVertex.coord = pair.coord;
+        mesh.vertices[v1] = newVertex;
+        validVertices[v2] = false;
+        vertexPairs.erase(v1, pairID);
+
+        // move the pairs of v2 to v1, a pair to a vertex v1 already pairs
+        // with is a duplicate and dies, its id goes to duplicates to leave
+        // the heap; pushing to v1 may move the lists, so v2 is indexed
+        // afresh every time
+        for (std::size_t k = 0; k < vertexPairs[v2].size(); k++)
+        {
+            const auto id = vertexPairs[v2][k];
+            if (id == pairID)
+                continue;
 
-        // merge faces from v2 to v1
+            auto &pair = pairs[id];
+            auto &end = pair.v1 == v2 ? pair.v1 : pair.v2;
+            const auto other = pair.v1 == v2 ? pair.v2 : pair.v1;
+            const auto v1Pairs = vertexPairs[v1];
+            const bool duplicate = std::any_of(v1Pairs.begin(), v1Pairs.end(), [&](int p)
+                                               { return pairs[p].v1 == other || pairs[p].v2 == other; });
+            if (duplicate)
+            {
+                duplicates.emplace_back(id);
+                vertexPairs.erase(other, id);
+                continue;
+            }
+
+            end = v1;
+            vertexPairs.push_back(v1, id);
+        }
+        vertexPairs.clear(v2);
+
+        // merge faces from v2 to v1, faces around both become degenerate
         int degenerateFace = 0;
-        for (auto faceID : vertexFaces[pair.v2])
+        for (std::size_t k = 0; k < vertexFaces[v2].size(); k++)
         {
+            const auto faceID = vertexFaces[v2][k];
             if (!validFaces[faceID])
                 continue;
 
             auto &face = mesh.faces.at(faceID);
             for (int i = 0; i < face.size(); i++)
             {
-                if (face[i] == pair.v1)
+                if (face[i] == v1)
                     validFaces[faceID] = false;
 
-                if (face[i] == pair.v2)
-                    face[i] = pair.v1;
+                if (face[i] == v2)
+                    face[i] = v1;
             }
 
             if (!validFaces[faceID])
                 degenerateFace++;
+            else
+                vertexFaces.push_back(v1, faceID);
+        }
+        vertexFaces.clear(v2);
+        vertexFaces.erase_if(v1, [&](int faceID)
+                             { return !validFaces[faceID]; });
+
+        return degenerateFace;
+    };
 
-            vertexFaces[pair.v1].emplace(faceID);
+    template <typename T, typename R>
+    void QuadricErrorMetrics<T, R>::update_kp(int pairID)
+    {
+        // Kp of v1 once v2 is merged into it
+        const auto v1 = pairs[pairID].v1;
+        if (quadrics == Quadrics::accumulate)
+        {
+            vertexKp[v1] += vertexKp[pairs[pairID].v2];
+            return;
         }
-        vertexFaces[pair.v2].clear();
 
-        // update Kp
-        for (auto faceID : vertexFaces[pair.v1])
+        for (auto faceID : vertexFaces[v1])
             if (validFaces[faceID])
                 update_face_kp(faceID);
 
-        update_vertex_kp(pair.v1);
+        update_vertex_kp(v1);
+    }
 
-        // insert new pairs
-        for (auto faceID : vertexFaces[pair.v1])
-        {
-            const auto &face = mesh.faces.at(faceID);
-            if (!validFaces[faceID])
-                continue;
+    template <typename T, typename R>
+    void QuadricErrorMetrics<T, R>::update_face_kp(int faceID)
+    {
+        const auto &face = mesh.faces[faceID];
+        const auto v0 = _private::convert<R>(mesh.vertices[face[0]].coord);
+        const auto cross = vec::product(_private::convert<R>(mesh.vertices[face[1]].coord) - v0,
+                                        _private::convert<R>(mesh.vertices[face[2]].coord) - v0);
 
-            std::array<int, 6> edges{face[0], face[1],
-                                     face[1], face[2],
-                                     face[2], face[0]};
-            for (auto j = 0; j < edges.size(); j += 2)
-                if (edges[j + 0] == pair.v1 || edges[j + 1] == pair.v1)
-                    emplace_pair(edges[j + 0], edges[j + 1]);
+        // a face without area has no plane, and must not turn Kp into NaN
+        if (!(vec::norm2(cross) > 0))
+        {
+            faceKp[faceID].fill(static_cast<R>(0));
+            return;
         }
 
-        return degenerateFace;
-    };
-
-    template <typename T>
-    void QuadricErrorMetrics<T>::update_face_kp(int faceID)
-    {
-        const auto &v0 = mesh.vertices[mesh.faces[faceID][0]].coord;
-        auto normal = vec::normalize(
-            vec::product(
-                mesh.vertices[mesh.faces[faceID][1]].coord - v0,
-                mesh.vertices[mesh.faces[faceID][2]].coord - v0));
-
+        auto normal = vec::normalize(cross);
         auto a = normal[0];
         auto b = normal[1];
         auto c = normal[2];
@@ -205,72 +479,90 @@ namespace quadric_error_metrics
                                          /*                */ d * d);
     }
 
-    template <typename T>
-    void QuadricErrorMetrics<T>::update_vertex_kp(int verticeID)
+    template <typename T, typename R>
+    void QuadricErrorMetrics<T, R>::update_vertex_kp(int verticeID)
     {
-        vertexKp[verticeID].fill(static_cast<T>(0));
+        vertexKp[verticeID].fill(static_cast<R>(0));
         for (auto faceID : vertexFaces[verticeID])
             if (validFaces[faceID])
                 vertexKp[verticeID] += faceKp[faceID];
     }
 
-    template <typename T>
-    void QuadricErrorMetrics<T>::emplace_pair(int v1, int v2)
+    template <typename T, typename R>
+    R QuadricErrorMetrics<T, R>::price_pair(int pairID)
     {
-        // TODO
-        std::vector<mesh::Vertex<T>> vertices{
-            mesh.vertices[v1],
-            mesh.vertices[v2],
-            mesh::interpolate(0.5, mesh.vertices[v1], mesh.vertices[v2])};
-
-        auto minQuadricError = std::numeric_limits<T>::max();
-        auto minQuadricErrorVertex = -1;
-        for (auto i = 0; i < vertices.size(); i++)
+        auto &pair = pairs[pairID];
+        const auto &a = mesh.vertices[pair.v1];
+        const auto &b = mesh.vertices[pair.v2];
+
+        // Kp potentially contains planes(v1) ∩ planes(v2) twice.
+        const auto kp = vertexKp[pair.v1] + vertexKp[pair.v2];
+
+        // v1, v2 and the midpoint, in case the optimum is not usable
+        auto point = [&](T t)
+        { return t == 0 ? a.coord : t == 1 ? b.coord : vec::interpolate(t, a.coord, b.coord); };
+        const std::array<T, 3> candidates{0, 1, 0.5};
+        auto minQuadricError = std::numeric_limits<R>::max();
+        T minT = 0;
+        for (auto t : candidates)
         {
-            // Calc quadric error, Kp potentially contains planes(v1) ∩ planes(v2) twice.
-            vec::Vec4<T> v(vertices[i].coord, 1);
-            T quadricError = std::abs(v * (vertexKp[v1] + vertexKp[v2]) * v);
-
+            const R quadricError = _private::quadric_error(kp, _private::convert<R>(point(t)));
             if (quadricError < minQuadricError)
             {
                 minQuadricError = quadricError;
-                minQuadricErrorVertex = i;
+                minT = t;
+            }
+        }
+
+        // the optimum, if it is well defined and stays near the edge
+        Vec3<R> optimum;
+        const auto edge = b.coord - a.coord;
+        const auto edgeLength2 = vec::norm2(edge);
+        if (_private::optimal_position(kp, optimum) &&
+            vec::distance2(_private::convert<T>(optimum), vec::interpolate(0.5, a.coord, b.coord)) <= edgeLength2)
+        {
+            const R quadricError = _private::quadric_error(kp, optimum);
+            if (quadricError <= minQuadricError)
+            {
+                // val and normal from the closest point of the edge
+                const auto p = _private::convert<T>(optimum);
+                const auto ap = p - a.coord;
+                const T t = edgeLength2 > 0 ? (ap[0] * edge[0] + ap[1] * edge[1] + ap[2] * edge[2]) / edgeLength2 : 0;
+                pair.coord = p;
+                pair.t = std::clamp<T>(t, 0, 1);
+                return quadricError;
             }
         }
 
-        pairs.emplace(Pair<T>{
-            v1 : v1,
-            v2 : v2,
-            version : vertexVersions[v1] + vertexVersions[v2],
-            quadricError : minQuadricError,
-            newVertex : vertices[minQuadricErrorVertex]
-        });
+        pair.coord = point(minT);
+        pair.t = minT;
+        return minQuadricError;
     }
 
-    template <typename T>
-    void QuadricErrorMetrics<T>::tidy_mesh()
+    template <typename T, typename R>
+    void QuadricErrorMetrics<T, R>::tidy_mesh()
     {
         // remove invalid vertices
+        std::vector<int> index(mesh.vertices.size(), -1);
         int i = 0;
-        for (int j = 0; j < mesh.vertices.size(); j++)
+        for (std::size_t j = 0; j < mesh.vertices.size(); j++)
         {
-            if (vertexVersions[j] == INVALID)
+            if (!validVertices[j])
                 continue;
 
-            for (auto faceID : vertexFaces[j])
-                for (int k = 0; k < mesh.faces[faceID].size(); k++)
-                    if (mesh.faces[faceID][k] == j)
-                        mesh.faces[faceID][k] = i;
-
+            index[j] = i;
             mesh.vertices[i++] = mesh.vertices[j];
         }
         mesh.vertices.resize(i);
 
         // remove invalid faces
         i = 0;
-        for (int j = 0; j < mesh.faces.size(); j++)
+        for (std::size_t j = 0; j < mesh.faces.size(); j++)
             if (validFaces[j])
-                mesh.faces[i++] = mesh.faces[j];
+            {
+                const auto &face = mesh.faces[j];
+                mesh.faces[i++] = Vec3<int>{index[face[0]], index[face[1]], index[face[2]]};
+            }
 
         mesh.faces.resize(i);
     }
@@ -1,14 +1,23 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <functional>
 #include <exception>
 #include <type_traits>
 #include <string>
 #include <iostream>
 #include <iomanip>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ThreadPool.hpp"
 
 namespace util
 {
-    void print_duration_info(const std::string &title, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point stop)
+    inline void print_duration_info(const std::string &title, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point stop)
     {
         std::chrono::nanoseconds nanoseconds = stop - start;
 
@@ -55,4 +64,117 @@ namespace util
             return result;
         }
     }
+
+    enum class SimdLevel
+    {
+        scalar,
+        sse2,
+        avx2
+    };
+
+    inline SimdLevel detect_simd_level()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return SimdLevel::avx2;
+
+        if (__builtin_cpu_supports("sse2"))
+            return SimdLevel::sse2;
+#endif
+        return SimdLevel::scalar;
+    }
+
+    // widest instruction set of this CPU, SIMD kernels dispatch on it at run time
+    inline SimdLevel simd_level()
+    {
+        static const auto level = detect_simd_level();
+        return level;
+    }
+
+    inline int hardware_threads()
+    {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    /**
+     * Run func(i) for i in [0, n) on up to `threads` threads: the caller and
+     * helpers from the shared pool. Tasks are pulled from a shared counter so
+     * uneven tasks balance out. Blocks until done and rethrows the first
+     * exception thrown by any task.
+     *
+     * The caller works through the tasks itself and only waits for tasks a
+     * helper has already taken, so nested calls cannot deadlock the pool.
+     */
+    template <typename Func>
+    void parallel_for(int n, int threads, const Func &func)
+    {
+        threads = std::min(threads, n);
+        if (threads <= 1)
+        {
+            for (int i = 0; i < n; i++)
+                func(i);
+
+            return;
+        }
+
+        // shared with helpers that may start after this call returned
+        struct State
+        {
+            std::atomic<int> next = 0;
+            int running = 0;
+            std::mutex mutex;
+            std::condition_variable finished;
+            std::exception_ptr error;
+        };
+
+        auto state = std::make_shared<State>();
+        auto worker = [state, n, &func]()
+        {
+            while (true)
+            {
+                {
+                    std::lock_guard lock(state->mutex);
+                    state->running++;
+                }
+
+                const int i = state->next++;
+                if (i < n)
+                {
+                    try
+                    {
+                        func(i);
+                    }
+                    catch (...)
+                    {
+                        std::lock_guard lock(state->mutex);
+                        if (!state->error)
+                            state->error = std::current_exception();
+
+                        state->next = n;
+                    }
+                }
+
+                std::lock_guard lock(state->mutex);
+                if (--state->running == 0)
+                    state->finished.notify_all();
+
+                if (i >= n)
+                    return;
+            }
+        };
+
+        auto &pool = ThreadPool::shared();
+        pool.reserve(threads - 1);
+        for (int i = 1; i < threads; i++)
+            pool.submit(worker);
+
+        worker();
+        std::unique_lock lock(state->mutex);
+        state->finished.wait(lock, [&]()
+                             { return state->running == 0; });
+
+        if (state->error)
+            std::rethrow_exception(state->error);
+    }
 }